@@ -0,0 +1,121 @@
+--[[
+*********************************************************************************
+** Copyright(C) 2020-2024 https://www.iccgame.com/
+** Author: zhaozp@iccgame.com
+*********************************************************************************
+]]--
+
+--------------------------------------------------------------------------------
+
+local format = string.format;
+
+--usage: skynet bench.echo [connections] [seconds] [port]
+--local clients keep one message each in flight to a local echo server, over
+--plain tcp and over websocket; build once as usual and once with make
+--IO_URING=1 and run both on the same host to compare epoll with io_uring
+
+local cases = {
+  { family = "tcp", size = 64   },
+  { family = "tcp", size = 4096 },
+  { family = "ws",  size = 64   },
+  { family = "ws",  size = 4096 },
+};
+
+--------------------------------------------------------------------------------
+
+local function run_case(port, family, size, connections, seconds)
+  local payload = string.rep("e", size);
+  local rounds, ready, failed = 0, 0, 0;
+  local running = true;
+
+  local acceptor = io.acceptor();
+  if not acceptor:listen(port, "127.0.0.1", 4096) then
+    error(format("can't listen on port %d", port));
+    return;
+  end
+
+  local peers = {};
+  acceptor:accept(io.socket(family), function(ec, peer)
+    if ec ~= 0 then
+      return;
+    end
+    peers[#peers + 1] = peer;
+    peer:receive(function(ec, data)
+      if ec ~= 0 then
+        return;
+      end
+      peer:send(data);
+    end);
+  end, 64, true);
+
+  local clients = {};
+  for i = 1, connections do
+    local client = io.socket(family);
+    local pending = 0;
+    clients[i] = client;
+    client:connect("127.0.0.1", port, function(ec)
+      if ec ~= 0 then
+        failed = failed + 1;
+        return;
+      end
+      client:receive(function(ec, data)
+        if ec ~= 0 then
+          return;
+        end
+        --a tcp stream may hand the echo back in pieces
+        pending = pending - #data;
+        if pending > 0 then
+          return;
+        end
+        rounds = rounds + 1;
+        if running then
+          pending = size;
+          client:send(payload);
+        end
+      end);
+      ready = ready + 1;
+    end);
+  end
+
+  local deadline = os.clock("ms") + 5000;
+  while ready + failed < connections and os.clock("ms") < deadline do
+    os.wait(10);
+  end
+
+  local begin = os.clock("ms");
+  for _, client in ipairs(clients) do
+    client:send(payload);
+  end
+  while os.clock("ms") - begin < seconds * 1000 and not os.stopped() do
+    os.wait(100);
+  end
+  running = false;
+  local elapsed = (os.clock("ms") - begin) / 1000;
+  local done = rounds;
+
+  for _, client in ipairs(clients) do
+    client:close();
+  end
+  for _, peer in ipairs(peers) do
+    peer:close();
+  end
+  acceptor:close();
+
+  print(format("%-4s %6d B %6d conns %10d echoes/s %10.2f MB/s", family, size, ready,
+    math.floor(done / elapsed), done * size * 2 / elapsed / 1048576));
+end
+
+--------------------------------------------------------------------------------
+
+function main(connections, seconds, port)
+  connections = math.tointeger(tonumber(connections)) or 100;
+  seconds = math.tointeger(tonumber(seconds)) or 5;
+  port = math.tointeger(tonumber(port)) or 19180;
+  print(format("echo round trips on %s, %d s per case", io.backend(), seconds));
+
+  for i, case in ipairs(cases) do
+    run_case(port + i, case.family, case.size, connections, seconds);
+  end
+end
+
+--------------------------------------------------------------------------------
@@ -0,0 +1,84 @@
+--[[
+*********************************************************************************
+** Copyright(C) 2020-2024 https://www.iccgame.com/
+** Author: zhaozp@iccgame.com
+*********************************************************************************
+]]--
+
+--------------------------------------------------------------------------------
+
+local format = string.format;
+
+--usage: skynet bench.json [payload.json] [rounds]
+--without a payload file a typical broker response is generated
+
+--------------------------------------------------------------------------------
+
+local function sample_payload()
+  local items = {};
+  for i = 1, 64 do
+    items[i] = {
+      id      = 100000 + i,
+      name    = format("item-%d", i),
+      price   = i * 1.25,
+      enabled = (i % 2 == 0),
+      tags    = { "hot", "new", "sale" },
+      owner   = { uid = 5000 + i, nick = "player\t\"quoted\"", level = i % 60 },
+    };
+  end
+  return json.encode({ code = 0, message = "success", data = { total = #items, items = items } });
+end
+
+--------------------------------------------------------------------------------
+
+local function load_payload(filename)
+  if not filename or filename == "" then
+    return sample_payload();
+  end
+  local file = io.open(filename, "rb");
+  if not file then
+    error(format("can't open %s", filename));
+    return;
+  end
+  local text = file:read("a");
+  file:close();
+  return text;
+end
+
+--------------------------------------------------------------------------------
+
+local function measure(name, rounds, bytes, func, ...)
+  local begin = os.clock();
+  for i = 1, rounds do
+    func(...);
+  end
+  local elapsed = os.clock() - begin;
+  if elapsed <= 0 then
+    elapsed = 0.001;
+  end
+  print(format("%-16s %8d ops/s %10.2f MB/s", name, math.floor(rounds / elapsed), bytes * rounds / elapsed / 1048576));
+end
+
+--------------------------------------------------------------------------------
+
+function main(filename, rounds)
+  local text = load_payload(filename);
+  if not text then
+    return;
+  end
+  rounds = math.tointeger(tonumber(rounds)) or 20000;
+
+  local value = json.decode(text);
+  local packed = json.to_msgpack(text);
+  local sorted = { sort_keys = true };
+  print(format("payload %d bytes, %d rounds", #text, rounds));
+
+  measure("json.decode",       rounds, #text, json.decode, text);
+  measure("json.encode",       rounds, #text, json.encode, value);
+  measure("json.encode(sort)", rounds, #text, json.encode, value, sorted);
+  measure("json.to_msgpack",   rounds, #text, json.to_msgpack, text);
+  measure("json.from_msgpack", rounds, #text, json.from_msgpack, packed);
+  measure("unwrap+encode",     rounds, #text, function() return json.encode(unwrap(packed)) end);
+end
+
+--------------------------------------------------------------------------------
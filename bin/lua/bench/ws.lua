@@ -0,0 +1,121 @@
+--[[
+*********************************************************************************
+** Copyright(C) 2020-2024 https://www.iccgame.com/
+** Author: zhaozp@iccgame.com
+*********************************************************************************
+]]--
+
+--------------------------------------------------------------------------------
+
+local format = string.format;
+
+--usage: skynet bench.ws [megabytes] [port]
+--a local ws client sends masked frames of 64 B to 1 MiB to a local ws server,
+--the time is taken from the first send until the server got the last frame,
+--permessage-deflate is negotiated as usual, so its cost is included
+
+local sizes = { 64, 512, 4096, 65536, 262144, 1048576 };
+local max_count = 200000;
+
+--------------------------------------------------------------------------------
+
+--binary and hard to compress, like most real payloads
+local function make_payload(size)
+  local words = {};
+  local seed = 0x2545f491;
+  for i = 1, size // 8 + 1 do
+    seed = (seed * 1103515245 + 12345) % 2147483648;
+    words[i] = string.pack("<I8", seed * 2654435761);
+  end
+  return "\1" .. table.concat(words):sub(2, size);
+end
+
+--------------------------------------------------------------------------------
+
+local function size_name(bytes)
+  if bytes >= 1048576 then
+    return format("%d MiB", bytes // 1048576);
+  end
+  if bytes >= 1024 then
+    return format("%d KiB", bytes // 1024);
+  end
+  return format("%d B", bytes);
+end
+
+--------------------------------------------------------------------------------
+
+local function run_case(port, size, total)
+  local count = math.max(1, math.min(max_count, total // size));
+  local payload = make_payload(size);
+  local received, bytes = 0, 0;
+  local begin, elapsed;
+
+  local acceptor = io.acceptor();
+  if not acceptor:listen(port, "127.0.0.1") then
+    error(format("can't listen on port %d", port));
+    return;
+  end
+
+  local peers = {};
+  acceptor:accept(io.socket("ws"), function(ec, peer)
+    if ec ~= 0 then
+      return;
+    end
+    peers[#peers + 1] = peer;
+    peer:receive(function(ec, data)
+      if ec ~= 0 then
+        return;
+      end
+      received = received + 1;
+      bytes = bytes + #data;
+      if received == count then
+        elapsed = os.clock("ms") - begin;
+      end
+    end);
+  end);
+
+  local client = io.socket("ws");
+  client:connect("127.0.0.1", port, function(ec)
+    if ec ~= 0 then
+      elapsed = -1;
+      return;
+    end
+    begin = os.clock("ms");
+    for i = 1, count do
+      client:send(payload);
+    end
+  end);
+
+  while not elapsed and not os.stopped() do
+    os.wait(100);
+  end
+  client:close();
+  acceptor:close();
+  for _, peer in ipairs(peers) do
+    peer:close();
+  end
+
+  if not elapsed or elapsed < 0 then
+    print(format("%-8s connect failed", size_name(size)));
+    return;
+  end
+  if elapsed <= 0 then
+    elapsed = 1;
+  end
+  local seconds = elapsed / 1000;
+  print(format("%-8s %8d frames %10d frames/s %10.2f MB/s", size_name(size), count, math.floor(count / seconds), bytes / seconds / 1048576));
+end
+
+--------------------------------------------------------------------------------
+
+function main(megabytes, port)
+  megabytes = math.tointeger(tonumber(megabytes)) or 32;
+  port = math.tointeger(tonumber(port)) or 19080;
+  print(format("ws receive throughput, %d MB per frame size", megabytes));
+
+  for i, size in ipairs(sizes) do
+    run_case(port + i, size, megabytes * 1048576);
+  end
+end
+
+--------------------------------------------------------------------------------
@@ -15,19 +15,34 @@ local proto_type = require("cluster.protocol");
 local active_sessions = {};
 local lua_bounds      = {};
 local default_port    = 80;
+local dict_header     = "xforword-dict";
+local dict_format     = "msgpack";
+
+--remote callers are (caller << remote_shift | session id), local ids fit in local_mask
+local remote_shift    = 32;
+local local_mask      = 0x7fffffff;
 
 --------------------------------------------------------------------------------
 
-local function sendto_others(data)
+local function sendto_others(info)
   for id, session in pairs(active_sessions) do
-    session.socket:send(data);
+    session.socket:send(session.wrap(info));
   end
 end
 
 --------------------------------------------------------------------------------
 
-local function sendto_member(data, session)
-  session.socket:send(data);
+local function sendto_member(info, session)
+  session.socket:send(session.wrap(info));
+end
+
+--------------------------------------------------------------------------------
+
+local function use_dictionary(session)
+  local dict = session.dict;
+  session.wrap = function(...)
+    return dict:wrap(...);
+  end
 end
 
 --------------------------------------------------------------------------------
@@ -44,7 +59,7 @@ end
 --------------------------------------------------------------------------------
 
 local function lua_unbind(name, caller)
-  if caller > 0xffff then    
+  if caller > local_mask then    
 	os.r_unbind(name, caller);
   end
   lua_bounds[caller][name] = nil;
@@ -63,7 +78,7 @@ local function ws_on_error(ec, peer, msg)
 
   --cancel bind for the session
   for caller, v in pairs(lua_bounds) do
-    if caller > 0xffff and caller & 0xffff == id then
+    if caller > local_mask and caller & local_mask == id then
 	  for name, info in pairs(v) do
 	    lua_unbind(name, caller);
 	  end
@@ -81,15 +96,29 @@ local function ws_on_receive(peer, ec, data)
   end
   
   local id   = peer:id();
-  local info = unwrap(data);
+  local session = active_sessions[id];
+  if not session then
+    return;
+  end
+  
+  local info = session.dict:unwrap(data);
+  if not info then
+    ws_on_error(ec, peer, "unwrap error");
+    return;
+  end
+  
   local what = info.what;
+  if what == proto_type.dictionary then
+    use_dictionary(session);
+	return;
+  end
   
   if what == proto_type.deliver then
     local name   = info.name;
 	local argv   = info.argv;
 	local mask   = info.mask;
 	local who    = info.who;
-	local caller = info.caller << 16 | id;
+	local caller = info.caller << remote_shift | id;
 	local rcf    = info.rcf;
 	os.r_deliver(name, argv, mask, who, caller, rcf);
 	return;
@@ -106,7 +135,7 @@ local function ws_on_receive(peer, ec, data)
   if what == proto_type.bind then
     local name   = info.name;
 	local rcb    = info.rcb;
-	local caller = info.caller << 16 | id;
+	local caller = info.caller << remote_shift | id;
 	lua_bind(info, caller);
 	os.r_bind(name, caller, rcb);
 	return;
@@ -114,7 +143,7 @@ local function ws_on_receive(peer, ec, data)
   
   if what == proto_type.unbind then
     local name   = info.name;
-	local caller = info.caller << 16 | id;
+	local caller = info.caller << remote_shift | id;
 	lua_unbind(name, caller);
 	return;
   end
@@ -126,39 +155,39 @@ local function on_lookout(info)
   local what = info.what;  
   if what == proto_type.bind then
 	lua_bind(info, info.caller);
-    sendto_others(wrap(info));
+    sendto_others(info);
 	return;
   end
   
   if what == proto_type.unbind then
 	lua_unbind(info.name, info.caller);
-    sendto_others(wrap(info));
+    sendto_others(info);
 	return;
   end
   
   local id;
   if what == proto_type.deliver then
-    id = info.who & 0xffff;
-	info.who = info.who >> 16;
+    id = info.who & local_mask;
+	info.who = info.who >> remote_shift;
   end
   
   if what == proto_type.response then
-    id = info.caller & 0xffff;
-	info.caller = info.caller >> 16;
+    id = info.caller & local_mask;
+	info.caller = info.caller >> remote_shift;
   end
   
   local session = active_sessions[id];
   if session then
-    sendto_member(wrap(info), session);
+    sendto_member(info, session);
   end
 end
 
 --------------------------------------------------------------------------------
 
-local function new_session(protocol, peer)
+local function new_session(protocol, peer, accepted)
   local what = peer:getheader("xforword-join");
   if what ~= "skynet-lua" then
-    return false;
+    return nil;
   end
 
   local ip, port = peer:endpoint();
@@ -166,12 +195,20 @@ local function new_session(protocol, peer)
     socket = peer,
 	ip     = ip,
 	port   = port,
+	dict   = wrap_dict(),
+	wrap   = wrap,
   };
 
+  --the connecting side asks for a dictionary, the accepting side agrees
+  if accepted and peer:getheader(dict_header) == dict_format then
+    use_dictionary(session);
+	peer:send(session.wrap({what = proto_type.dictionary}));
+  end
+
   local id = peer:id();
   active_sessions[id] = session;
   peer:receive(bind(ws_on_receive, peer));
-  return true;
+  return session;
 end
 
 --------------------------------------------------------------------------------
@@ -193,15 +230,16 @@ local function ws_on_accept(protocol, ec, peer)
 	return;
   end
 
-  if not new_session(protocol, peer) then
+  local session = new_session(protocol, peer, true);
+  if not session then
     peer:close();
 	return;
   end
 
   for caller, bounds in pairs(lua_bounds) do
-    if caller <= 0xffff then
+    if caller <= local_mask then
 	  for name, info in pairs(bounds) do
-	    peer:send(wrap(info));
+	    sendto_member(info, session);
 	  end
 	end
   end
@@ -217,8 +255,9 @@ local function new_connect(host, port, protocol)
 
   local peer = io.socket(protocol);
   peer:setheader("xforword-join", "skynet-lua");
+  peer:setheader(dict_header, dict_format);
   if peer:connect(host, port) then
-    new_session(protocol, peer);
+    new_session(protocol, peer, false);
 	return true;
   end
   return false;
@@ -16,6 +16,7 @@ local protocol = {
   bind     = "bind",
   unbind   = "unbind",
   response = "response",
+  dictionary = "dictionary",
 };
 
 --------------------------------------------------------------------------------
@@ -298,14 +298,12 @@ end
 
 --------------------------------------------------------------------------------
 
-local function http_on_accept(protocol, ca, key, pwd, ec, peer)
+local function http_on_accept(ec, peer)
   if ec > 0 then
-    peer:close();
-  else
-    local session = http_new_session(peer);
-    peer:receive(bind(http_on_receive, session));
+    return;
   end
-  return io.socket(protocol, ca, key, pwd);
+  local session = http_new_session(peer);
+  peer:receive(bind(http_on_receive, session));
 end
 
 --------------------------------------------------------------------------------
@@ -326,7 +324,7 @@ function main(port, host, ca, key, pwd)
   end
 
   local socket = io.socket(protocol, ca, key, pwd);
-  acceptor:accept(socket, bind(http_on_accept, protocol, ca, key, pwd));  
+  acceptor:accept(socket, http_on_accept, 64, true);
   os.declare("http:index", skynet_version);
 
   print(format("%s works on port %d", os.name(), port));
@@ -69,13 +69,14 @@ local function on_accept(context, ec, peer)
     end
   end
   if ec > 0 or not peer:valid() then
-    peer:close();
-  else
-    local handler = context.receive_handler;
-    local session = new_session(peer, handler);
-    peer:receive(bind(on_receive, session));
+    if peer then
+      peer:close();
+    end
+    return;
   end
-  return new_socket(context);
+  local handler = context.receive_handler;
+  local session = new_session(peer, handler);
+  peer:receive(bind(on_receive, session));
 end
 
 --------------------------------------------------------------------------------
@@ -92,6 +93,9 @@ end
 
 function ws_class:close()
   self.acceptor:close();
+  if self.prototype then
+    self.prototype:close();
+  end
 end
 
 --------------------------------------------------------------------------------
@@ -106,15 +110,16 @@ end
 
 --------------------------------------------------------------------------------
 
-function ws_class:listen(port, host, backlog)
+function ws_class:listen(port, host, backlog, options)
   host = host or "0.0.0.0";
   port = port or (self.ca and 443 or 80);
-  local ok = self.acceptor:listen(port, host, backlog or 64);
+  local ok = self.acceptor:listen(port, host, backlog or 64, options);
   if not ok then
     return false;
   end
-  local socket = new_socket(self);
-  self.acceptor:accept(socket, bind(on_accept, self));
+  --new peers are copies of the prototype, accepted in batches by the host
+  self.prototype = new_socket(self);
+  self.acceptor:accept(self.prototype, bind(on_accept, self), 64, true);
   return true;
 end
 
@@ -47,6 +47,7 @@
 #include "eport/detail/timer/system_timer.hpp"
 #include "eport/detail/timer/high_resolution_timer.hpp"
 #include "eport/detail/socket/address.hpp"
+#include "eport/detail/socket/dns.hpp"
 #include "eport/detail/socket/tcp/endpoint.hpp"
 #include "eport/detail/socket/tcp/socket.hpp"
 #include "eport/detail/socket/tcp/acceptor.hpp"
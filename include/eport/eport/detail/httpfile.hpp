@@ -26,12 +26,12 @@ public:
     }
     error_code ec;
     auto port  = (unsigned short)atoi(_port.c_str());
-    auto plist = ip::tcp::resolve(_host.c_str(), port, ec);
-    if (plist.empty()) {
+    auto list = ip::dns::instance().resolve(_host, ec);
+    if (ec) {
       return false;
     }
     _request.reset();
-    _socket->connect(*plist.begin(), ec);
+    _socket->connect(ip::tcp::endpoint(ip::dns::pick(list), port), ec);
     return ec.value() == 0;
   }
 
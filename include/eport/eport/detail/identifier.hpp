@@ -1,14 +1,14 @@
-
-
 #pragma once
 
 #include <mutex>
-#include <list>
+#include <atomic>
+#include <vector>
+#include <deque>
 #include <memory>
 
 #include "eport/3rd.hpp"
 
-#define MAX_IDENTIFIER 0xffff
+#define MAX_IDENTIFIER 0x7fffffff
 
 /***********************************************************************************/
 namespace eport {
@@ -18,32 +18,90 @@ class identifiers final {
   friend class identifier;
   typedef std::shared_ptr<identifiers> value_type;
 
+  enum { batch_size = 64 };
+
+  /* ids released on a thread are reused by that thread first */
+  struct local_cache final {
+    value_type hold = instance();
+    std::vector<int> unused;
+    inline ~local_cache() { hold->spill(unused, 0); exited() = true; }
+  };
+
+  /* set once the thread's cache is gone, later releases go to the shared list */
+  static bool& exited() {
+    static thread_local bool _exited = false;
+    return _exited;
+  }
+
   static value_type instance() {
     static value_type _self(new identifiers());
     return _self;
   }
 
+  static local_cache& cache() {
+    static thread_local local_cache _cache;
+    return _cache;
+  }
+
   int pop() {
-    std::unique_lock<std::mutex> lock(_mutex);
-    if (_next <= MAX_IDENTIFIER) {
-      return _next++;
+    if (exited()) {
+      std::unique_lock<std::mutex> lock(_mutex);
+      if (!_unused.empty()) {
+        auto newid = _unused.front();
+        _unused.pop_front();
+        return newid;
+      }
+      return _next < MAX_IDENTIFIER ? _next++ : 0;
     }
-    if (_unused.empty()) {
-      return 0;
+    auto& unused = cache().unused;
+    if (unused.empty()) {
+      std::unique_lock<std::mutex> lock(_mutex);
+      for (int i = 0; i < batch_size && !_unused.empty(); i++) {
+        unused.push_back(_unused.front());
+        _unused.pop_front();
+      }
     }
-    auto newid = _unused.front();
-    _unused.pop_front();
-    return newid;
+    if (!unused.empty()) {
+      auto newid = unused.back();
+      unused.pop_back();
+      return newid;
+    }
+    if (_next.load(std::memory_order_relaxed) < MAX_IDENTIFIER) {
+      auto newid = _next.fetch_add(1);
+      if (newid > 0 && newid < MAX_IDENTIFIER) {
+        return newid;
+      }
+    }
+    return 0;
   }
 
   void push(int v) {
+    if (v <= 0) {
+      return;
+    }
+    if (exited()) {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _unused.push_back(v);
+      return;
+    }
+    auto& unused = cache().unused;
+    unused.push_back(v);
+    if (unused.size() >= batch_size * 2) {
+      spill(unused, batch_size);
+    }
+  }
+
+  void spill(std::vector<int>& unused, size_t keep) {
     std::unique_lock<std::mutex> lock(_mutex);
-    _unused.push_back(v);
+    while (unused.size() > keep) {
+      _unused.push_back(unused.back());
+      unused.pop_back();
+    }
   }
 
   std::mutex _mutex;
-  int _next = 1;
-  std::list<int> _unused;
+  std::atomic<int> _next{1};
+  std::deque<int> _unused;
 };
 
 /***********************************************************************************/
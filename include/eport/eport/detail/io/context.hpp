@@ -3,6 +3,7 @@
 #pragma once
 
 #include "eport/detail/identifier.hpp"
+#include "eport/detail/timer/timing_wheel.hpp"
 
 /***********************************************************************************/
 namespace eport {
@@ -13,6 +14,7 @@ class io_context : public asio::io_context {
   typedef asio::executor_work_guard<executor_type> work_guard_t;
   identifier   _id;
   work_guard_t _work_guard;
+  timing_wheel _wheel;
 
 public:
   size_t run() {
@@ -95,10 +97,12 @@ public:
   typedef std::shared_ptr<io_context> value_type;
   static value_type create() { return value_type(new io_context()); }
   inline int id() const { return _id.value(); }
+  inline timing_wheel& wheel() { return _wheel; }
 
 private:
   io_context()
-    : _work_guard(asio::make_work_guard(*this)) { }
+    : _work_guard(asio::make_work_guard(*this))
+    , _wheel(*this) { }
   io_context(const service&) = delete;
 };
   
@@ -4,46 +4,83 @@
 #include <locale>
 #include <string>
 #include <memory>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
 
 /***********************************************************************************/
 namespace eport {
 /***********************************************************************************/
 
+/* strict UTF-8 (RFC 3629), ASCII runs are skipped 16 bytes at a time, n 0 means up to '\0' */
 inline bool is_utf8(const char* p, size_t n = 0)
 {
-  unsigned char chr;
-  size_t i = 0, follow = 0;
-  for (; n ? (i < n) : (p[i] != 0); i++) {
-    chr = p[i];
-    if (follow == 0) {
-      if (chr > 0x80) {
-        if (chr == 0xfc || chr == 0xfd) {
-          follow = 5;
-        }
-        else if (chr >= 0xf8) {
-          follow = 4;
-        }
-        else if (chr >= 0xf0) {
-          follow = 3;
-        }
-        else if (chr >= 0xe0) {
-          follow = 2;
-        }
-        else if (chr >= 0xc0) {
-          follow = 1;
-        }
-        else {
-          return false;
+  const unsigned char* s = (const unsigned char*)p;
+  const unsigned char* end = s + (n ? n : strlen(p));
+
+  while (s < end) {
+#if defined(__SSE2__) || defined(_M_X64)
+    while (end - s >= 16) {
+      if (_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)s))) {
+        break;
+      }
+      s += 16;
+    }
+#endif
+    while (end - s >= 8) {
+      uint64_t v;
+      memcpy(&v, s, sizeof(v));
+      if (v & 0x8080808080808080ULL) {
+        break;
+      }
+      s += 8;
+    }
+
+    /*byte by byte until the next ASCII run*/
+    while (s < end) {
+      unsigned char chr = *s;
+      if (chr < 0x80) {
+        if (++s < end && *s < 0x80) {
+          break;
         }
+        continue;
       }
-    } else {
-      follow--;
-      if ((chr & 0xC0) != 0x80) {
+      size_t follow = 0;
+      unsigned char lo = 0x80, hi = 0xbf; /*range of the second byte*/
+      if (chr >= 0xc2 && chr <= 0xdf) {
+        follow = 1;
+      }
+      else if (chr >= 0xe0 && chr <= 0xef) {
+        follow = 2;
+        if (chr == 0xe0) lo = 0xa0; /*overlong*/
+        if (chr == 0xed) hi = 0x9f; /*surrogates*/
+      }
+      else if (chr >= 0xf0 && chr <= 0xf4) {
+        follow = 3;
+        if (chr == 0xf0) lo = 0x90; /*overlong*/
+        if (chr == 0xf4) hi = 0x8f; /*above U+10FFFF*/
+      }
+      else {
+        return false;
+      }
+      if ((size_t)(end - s) <= follow) {
         return false;
       }
+      if (s[1] < lo || s[1] > hi) {
+        return false;
+      }
+      for (size_t i = 2; i <= follow; i++) {
+        if ((s[i] & 0xc0) != 0x80) {
+          return false;
+        }
+      }
+      s += follow + 1;
     }
   }
-  return (follow == 0);
+  return true;
 }
 
 /***********************************************************************************/
@@ -13,8 +13,13 @@ namespace ws    {
 class decoder final {
   const size_t max_packet;
   std::string _cache;
+  size_t _offset = 0; /* bytes of _cache already decoded */
   ws::context _context;
 
+  inline bool check_size() const {
+    return !max_packet || _context.packet.size() <= max_packet;
+  }
+
 public:
   inline decoder(size_t max_size = 0)
     : max_packet(max_size) {
@@ -28,27 +33,33 @@ public:
   }
   template <typename Handler>
   bool decode(const char* data, size_t size, Handler&& handler) {
+    if (_offset == _cache.size()) {
+      /*nothing is buffered, frames are decoded straight from the read*/
+      _cache.clear();
+      _offset = 0;
+      auto end = ws::decode(data, size, _context, handler);
+      if (end == nullptr || !check_size()) {
+        return false;
+      }
+      _cache.assign(end, (size_t)(data + size - end));
+      return true;
+    }
+    /*the decoded head is dropped only once it outweighs the tail*/
+    if (_offset > 0 && _offset >= _cache.size() - _offset) {
+      _cache.erase(0, _offset);
+      _offset = 0;
+    }
     _cache.append(data, size);
-    data = _cache.c_str();
-    size = _cache.size();
 
-    auto begin = data;
-    auto end   = ws::decode(data, size, _context, handler);
-    if (end == nullptr) {
+    auto begin = _cache.c_str() + _offset;
+    auto end   = ws::decode(begin, _cache.size() - _offset, _context, handler);
+    if (end == nullptr || !check_size()) {
       return false;
     }
-    if (max_packet) {
-      auto psize = _context.packet.size();
-      if (psize > max_packet) {
-        return false;
-      }
-    }
-    size_t removed = (size_t)(end - begin);
-    if (removed == size) {
+    _offset += (size_t)(end - begin);
+    if (_offset == _cache.size()) {
       _cache.clear();
-    }
-    else if (removed) {
-      _cache = _cache.substr(removed);
+      _offset = 0;
     }
     return true;
   }
@@ -72,6 +83,9 @@ public:
   inline void disable_mask() {
     _context.mask = false;
   }
+  inline bool is_masked() const {
+    return _context.mask;
+  }
   template <typename Handler>
   void encode(const char* data, size_t size, opcode_type opcode, bool inflate, Handler handler) {
     _context.inflate = inflate;
@@ -0,0 +1,185 @@
+
+
+#pragma once
+
+#include <string>
+#include <stdlib.h>
+#include "eport/detail/zlib/gzip.hpp"
+
+/*******************************************************************************/
+namespace eport {
+namespace io    {
+namespace ws    {
+/*******************************************************************************/
+
+struct deflate_options {
+  bool   enable      = true;  /* offer or accept permessage-deflate */
+  bool   takeover    = false; /* keep the compression history, peers must inflate that way */
+  int    window_bits = 15;    /* 9..15, the compressor uses 1 << (window_bits + 2) bytes */
+  int    mem_level   = 8;     /* 1..9, the compressor uses 1 << (mem_level + 9) bytes */
+  size_t min_size    = 16;    /* shorter messages are sent uncompressed */
+};
+
+/* the first permessage-deflate offer or answer of a header (RFC 7692) */
+struct deflate_params {
+  bool found = false;
+  bool server_no_context_takeover = false;
+  bool client_no_context_takeover = false;
+  int  server_max_window_bits = 15;
+  int  client_max_window_bits = 15;
+};
+
+inline deflate_params parse_deflate(const std::string& header) {
+  deflate_params params;
+  auto trim = [](const std::string& v) {
+    size_t b = v.find_first_not_of(" \t\"");
+    size_t e = v.find_last_not_of(" \t\"");
+    return b == std::string::npos ? std::string() : v.substr(b, e - b + 1);
+  };
+
+  size_t offset = 0;
+  while (offset <= header.size() && !params.found) {
+    size_t end = header.find(',', offset);
+    if (end == std::string::npos) {
+      end = header.size();
+    }
+    std::string offer = header.substr(offset, end - offset);
+    offset = end + 1;
+
+    size_t pos = 0;
+    bool first = true;
+    while (pos <= offer.size()) {
+      size_t next = offer.find(';', pos);
+      if (next == std::string::npos) {
+        next = offer.size();
+      }
+      std::string item = trim(offer.substr(pos, next - pos));
+      pos = next + 1;
+      if (first) {
+        if (item != "permessage-deflate") {
+          break;
+        }
+        params.found = true;
+        first = false;
+        continue;
+      }
+      std::string name = item, value;
+      size_t eq = item.find('=');
+      if (eq != std::string::npos) {
+        name  = trim(item.substr(0, eq));
+        value = trim(item.substr(eq + 1));
+      }
+      int bits = value.empty() ? 15 : atoi(value.c_str());
+      if (name == "server_no_context_takeover") {
+        params.server_no_context_takeover = true;
+      }
+      else if (name == "client_no_context_takeover") {
+        params.client_no_context_takeover = true;
+      }
+      else if (name == "server_max_window_bits") {
+        params.server_max_window_bits = bits;
+      }
+      else if (name == "client_max_window_bits") {
+        params.client_max_window_bits = bits;
+      }
+    }
+  }
+  return params;
+}
+
+/*******************************************************************************/
+
+/* per connection compression state of permessage-deflate */
+class deflate_codec final {
+  deflate_options _options;
+  zlib::deflater  _deflater;
+  zlib::inflater  _inflater;
+  bool            _compress = false;
+  bool            _takeover = true;
+  int             _bits     = 15;
+
+  inline int window_bits(int peer_max) const {
+    int bits = _options.window_bits < peer_max ? _options.window_bits : peer_max;
+    return bits > 15 ? 15 : bits;
+  }
+
+  inline void setup(int bits, bool takeover) {
+    /*zlib can't make raw streams for 256 bytes windows, such peers get plain messages*/
+    _deflater.init(bits, _options.mem_level, takeover);
+    _compress = (bits >= 9);
+    _takeover = takeover;
+    _bits     = bits;
+  }
+
+public:
+  inline void set_options(const deflate_options& options) {
+    _options = options;
+  }
+
+  inline const deflate_options& options() const {
+    return _options;
+  }
+
+  /* client side: the offer sent with the upgrade request */
+  inline std::string offer() const {
+    std::string ext = "permessage-deflate; client_max_window_bits";
+    if (!_options.takeover) {
+      ext += "; client_no_context_takeover";
+    }
+    return ext;
+  }
+
+  /* client side: applies the server's answer, false if it declined */
+  bool confirm(const std::string& answer) {
+    auto params = parse_deflate(answer);
+    if (!params.found || !_options.enable) {
+      return false;
+    }
+    bool takeover = _options.takeover && !params.client_no_context_takeover;
+    setup(window_bits(params.client_max_window_bits), takeover);
+    return true;
+  }
+
+  /* server side: the answer to the client's offer, empty if declined */
+  std::string accept(const std::string& offer) {
+    auto params = parse_deflate(offer);
+    if (!params.found || !_options.enable) {
+      return std::string();
+    }
+    bool takeover = _options.takeover && !params.server_no_context_takeover;
+    int  bits = window_bits(params.server_max_window_bits);
+    setup(bits, takeover);
+
+    std::string ext = "permessage-deflate";
+    if (!takeover) {
+      ext += "; server_no_context_takeover";
+    }
+    if (bits < 15) {
+      ext += "; server_max_window_bits=" + std::to_string(bits);
+    }
+    return ext;
+  }
+
+  /* false if the message should be sent as it is */
+  inline bool compress(const char* data, size_t size, std::string& out) {
+    if (!_compress || size < _options.min_size) {
+      return false;
+    }
+    return _deflater.compress(data, size, out);
+  }
+
+  /* a message deflated afresh with a full window is valid for this peer too */
+  inline bool shareable() const {
+    return _compress && !_takeover && _bits == 15;
+  }
+
+  inline bool decompress(const char* data, size_t size, std::string& out, size_t max_size) {
+    return _inflater.decompress(data, size, out, max_size);
+  }
+};
+
+/*******************************************************************************/
+} //end of namespace ws
+} //end of namespace io
+} //end of namespace eport
+/*******************************************************************************/
@@ -0,0 +1,297 @@
+
+
+#pragma once
+
+#include <string>
+#include <string.h>
+#include "eport/3rd.hpp"
+
+/*******************************************************************************/
+namespace eport {
+namespace io    {
+/*******************************************************************************/
+
+enum struct framing_type {
+  none,     /* every read is delivered as it is */
+  u16be,    /* 2 bytes big-endian length, then the payload */
+  u32le,    /* 4 bytes little-endian length, then the payload */
+  line,     /* ends with '\n', a trailing '\r' is removed */
+  msgpack   /* one complete msgpack object */
+};
+
+/* where a msgpack scan stopped, so the next read carries on from there */
+struct msgpack_scan {
+  size_t pos    = 0; /* end of the last complete element */
+  size_t remain = 1; /* elements still to read */
+};
+
+/* size of the msgpack object at data, 0 if incomplete, -1 if malformed;
+   an incomplete scan leaves st at its last complete element */
+inline long long msgpack_size(const char* data, size_t size, msgpack_scan& st) {
+  const unsigned char* p = (const unsigned char*)data;
+  size_t pos = st.pos;
+  size_t remain = st.remain;
+
+  auto length = [&](size_t n, size_t& out) -> bool {
+    if (size - pos < n) {
+      return false;
+    }
+    out = 0;
+    for (size_t i = 0; i < n; i++) {
+      out = (out << 8) | p[pos++];
+    }
+    return true;
+  };
+
+  while (remain > 0) {
+    st.pos = pos;
+    st.remain = remain;
+    if (pos >= size) {
+      return 0;
+    }
+    unsigned char c = p[pos++];
+    remain--;
+
+    size_t skip = 0, n = 0;
+    if (c <= 0x7f || c >= 0xe0) {
+      continue;                        /* fixint */
+    }
+    if (c <= 0x8f) {
+      remain += (size_t)(c & 0x0f) * 2; /* fixmap */
+      continue;
+    }
+    if (c <= 0x9f) {
+      remain += (c & 0x0f);            /* fixarray */
+      continue;
+    }
+    if (c <= 0xbf) {
+      skip = (c & 0x1f);               /* fixstr */
+    }
+    else switch (c) {
+    case 0xc0: case 0xc2: case 0xc3:
+      continue;
+    case 0xc4: case 0xd9:
+      if (!length(1, skip)) return 0;
+      break;
+    case 0xc5: case 0xda:
+      if (!length(2, skip)) return 0;
+      break;
+    case 0xc6: case 0xdb:
+      if (!length(4, skip)) return 0;
+      break;
+    case 0xc7:
+      if (!length(1, skip)) return 0;
+      skip += 1;
+      break;
+    case 0xc8:
+      if (!length(2, skip)) return 0;
+      skip += 1;
+      break;
+    case 0xc9:
+      if (!length(4, skip)) return 0;
+      skip += 1;
+      break;
+    case 0xcc: case 0xd0: skip = 1; break;
+    case 0xcd: case 0xd1: skip = 2; break;
+    case 0xca: case 0xce: case 0xd2: skip = 4; break;
+    case 0xcb: case 0xcf: case 0xd3: skip = 8; break;
+    case 0xd4: skip = 2;  break;
+    case 0xd5: skip = 3;  break;
+    case 0xd6: skip = 5;  break;
+    case 0xd7: skip = 9;  break;
+    case 0xd8: skip = 17; break;
+    case 0xdc:
+      if (!length(2, n)) return 0;
+      remain += n;
+      continue;
+    case 0xdd:
+      if (!length(4, n)) return 0;
+      remain += n;
+      continue;
+    case 0xde:
+      if (!length(2, n)) return 0;
+      remain += n * 2;
+      continue;
+    case 0xdf:
+      if (!length(4, n)) return 0;
+      remain += n * 2;
+      continue;
+    default:
+      return -1;                       /* 0xc1 is never used */
+    }
+    if (size - pos < skip) {
+      return 0;
+    }
+    pos += skip;
+  }
+  st = msgpack_scan();
+  return (long long)pos;
+}
+
+inline long long msgpack_size(const char* data, size_t size) {
+  msgpack_scan st;
+  return msgpack_size(data, size, st);
+}
+
+/*******************************************************************************/
+
+/*
+ * splits a byte stream into frames, only a partial frame is kept between
+ * reads: _cache[_offset, size) is its start and the cache is compacted
+ * once the consumed prefix outgrows it, while _scan and _msgpack remember
+ * how far a line or msgpack frame was already looked at.
+ */
+class framer final {
+  framing_type _type = framing_type::none;
+  size_t _max_size   = 0;
+  size_t _offset     = 0;
+  size_t _scan       = 0;
+  msgpack_scan _msgpack;
+  std::string  _cache;
+
+  inline void reset() {
+    _cache.clear();
+    _offset  = 0;
+    _scan    = 0;
+    _msgpack = msgpack_scan();
+  }
+
+  /* Handler: void(const char* data, size_t size) */
+  template <typename Handler>
+  bool split(const char* data, size_t size, size_t& used, Handler& handler) {
+    while (used < size) {
+      const char* p = data + used;
+      size_t n = size - used;
+      size_t head = 0, body = 0;
+
+      switch (_type) {
+      case framing_type::u16be:
+        if (n < 2) {
+          return true;
+        }
+        head = 2;
+        body = ((size_t)(unsigned char)p[0] << 8) | (unsigned char)p[1];
+        break;
+
+      case framing_type::u32le:
+        if (n < 4) {
+          return true;
+        }
+        head = 4;
+        body = (size_t)(unsigned char)p[0]
+          | ((size_t)(unsigned char)p[1] << 8)
+          | ((size_t)(unsigned char)p[2] << 16)
+          | ((size_t)(unsigned char)p[3] << 24);
+        break;
+
+      case framing_type::line: {
+        size_t from = _scan < n ? _scan : 0;
+        auto pend = (const char*)memchr(p + from, '\n', n - from);
+        if (!pend) {
+          _scan = n;
+          return !(_max_size && n > _max_size);
+        }
+        _scan = 0;
+        body = (size_t)(pend - p);
+        if (_max_size && body > _max_size) {
+          return false;
+        }
+        used += body + 1;
+        if (body && p[body - 1] == '\r') {
+          body--;
+        }
+        handler(p, body);
+        continue;
+      }
+
+      case framing_type::msgpack: {
+        long long bytes = msgpack_size(p, n, _msgpack);
+        if (bytes < 0) {
+          return false;
+        }
+        if (bytes == 0) {
+          return !(_max_size && n > _max_size);
+        }
+        body = (size_t)bytes;
+        break;
+      }
+
+      default:
+        return false;
+      }
+
+      if (_max_size && body > _max_size) {
+        return false;
+      }
+      if (n < head + body) {
+        return true;
+      }
+      used += head + body;
+      handler(p + head, body);
+    }
+    return true;
+  }
+
+public:
+  inline void set(framing_type type, size_t max_size) {
+    _type = type;
+    _max_size = max_size;
+    reset();
+  }
+
+  inline bool enabled() const {
+    return _type != framing_type::none;
+  }
+
+  inline framing_type type() const {
+    return _type;
+  }
+
+  inline size_t max_size() const {
+    return _max_size;
+  }
+
+  inline void clear() {
+    reset();
+  }
+
+  /* Handler: void(const char* data, size_t size), false on a bad or oversized frame */
+  template <typename Handler>
+  bool feed(const char* data, size_t size, Handler&& handler) {
+    size_t used = 0;
+    if (_offset == _cache.size()) {
+      /*whole frames are handed out straight from the read buffer*/
+      _cache.clear();
+      _offset = 0;
+      if (!split(data, size, used, handler)) {
+        return false;
+      }
+      _cache.append(data + used, size - used);
+      return true;
+    }
+    /*the handler may reset the framer, so split works on a moved out cache*/
+    _cache.append(data, size);
+    std::string cache;
+    cache.swap(_cache);
+    used = _offset;
+    if (!split(cache.data(), cache.size(), used, handler)) {
+      return false;
+    }
+    cache.swap(_cache);
+    _offset = used;
+    if (_offset == _cache.size()) {
+      _cache.clear();
+      _offset = 0;
+    }
+    else if (_offset > _cache.size() - _offset) {
+      _cache.erase(0, _offset);
+      _offset = 0;
+    }
+    return true;
+  }
+};
+
+/*******************************************************************************/
+} //end of namespace io
+} //end of namespace eport
+/*******************************************************************************/
@@ -4,6 +4,10 @@
 
 #include "eport/3rd.hpp"
 #include "eport/detail/io/endian.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
 /*
 0                   1                   2                   3
 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
@@ -57,22 +61,39 @@ struct context {
   std::string   packet;
 };
 
-inline void do_convert(
-  const char* data, size_t bytes, context& ctx, const char* p_mask) {
-  char buffer[8192];
-  const size_t max_ix = sizeof(buffer) - 1;
+/* dst[i] = src[i] ^ p_mask[i % 4], 16 or 8 bytes at a time, dst may be src */
+inline void apply_mask(char* dst, const char* src, size_t bytes, const char* p_mask) {
+  u32 m32;
+  memcpy(&m32, p_mask, sizeof(m32));
+  size_t i = 0;
 
-  for (size_t i = 0; i < bytes; i++) {
-    char c1 = *data++;
-    char c2 = p_mask[i & 3];
-    auto ii = i & max_ix;
-    buffer[ii] = c1 ^ c2;
-    if ((ii == max_ix) || (i == bytes - 1)) {
-      ctx.packet.append(buffer, ii + 1);
-    }
+#if defined(__SSE2__) || defined(_M_X64)
+  const __m128i m128 = _mm_set1_epi32((int)m32);
+  for (; i + 16 <= bytes; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+    _mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(v, m128));
+  }
+#endif
+  const u64 m64 = ((u64)m32 << 32) | m32;
+  for (; i + 8 <= bytes; i += 8) {
+    u64 v;
+    memcpy(&v, src + i, sizeof(v));
+    v ^= m64;
+    memcpy(dst + i, &v, sizeof(v));
+  }
+  for (; i < bytes; i++) {
+    dst[i] = src[i] ^ p_mask[i & 3];
   }
 }
 
+/* appends the unmasked payload to ctx.packet */
+inline void do_convert(
+  const char* data, size_t bytes, context& ctx, const char* p_mask) {
+  size_t offset = ctx.packet.size();
+  ctx.packet.resize(offset + bytes);
+  apply_mask(&ctx.packet[offset], data, bytes, p_mask);
+}
+
 inline bool check_opcode(int opcode) {
   switch ((opcode_type)opcode) {
   case opcode_type::frame:
@@ -221,49 +242,60 @@ inline const char* decode(const char* data, size_t size, context& ctx, Handler&&
   return pend;
 }
 
+/* writes one frame header to out (at least 14 bytes), returns its size */
+inline size_t encode_head(char* out, opcode_type opcode, bool fin, bool inflate, bool client, size_t bytes, u32 mask)
+{
+  char* p = out;
+  unsigned char v1 = (unsigned char)opcode;
+  if (fin) {
+    v1 |= 0x80;
+  }
+  if (inflate) {
+    v1 |= 0x40;
+  }
+  *p++ = (char)v1;
+
+  unsigned char v2 = 0;
+  if (client) {
+    /*set mask*/
+    v2 |= 0x80;
+  }
+  if (bytes < 126) {
+    v2 |= (bytes & 0x7f);
+  }
+  else {
+    v2 |= 126;
+  }
+  *p++ = (char)v2;
+
+  /*append size and mask*/
+  if (bytes >= 126) {
+    p = ep_encode16(p, (u16)bytes);
+  }
+  if (client) {
+    p = ep_encode32(p, mask);
+  }
+  return (size_t)(p - out);
+}
+
 template <typename Handler>
 inline void encode(const char* data, size_t size, context& ctx, Handler&& handler)
 {
   const size_t frame_size = 0xffff;
   do {
-    unsigned char v1 = (unsigned char)ctx.opcode;
     size_t bytes = size > frame_size ? frame_size : size;
-    if (bytes == size) {
-      v1 |= 0x80;
-    }
-    if (ctx.inflate) {
-      v1 |= 0x40;
-    }
-    ctx.packet.append((char*)&v1, 1);
+    bool client = (ctx.what == session_type::client);
+    unsigned int mask = (client && ctx.mask) ? make_mask(data, bytes) : 0;
 
+    char head[16];
     char p_mask[4];
-    unsigned char v2 = 0;
-    if (ctx.what == session_type::client) {
-      /*set mask*/
-      v2 |= 0x80;
-    }
-    if (bytes < 126) {
-      v2 |= (bytes & 0x7f);
-    }
-    else {
-      v2 |= 126;
-    }
-    ctx.packet.append((char*)&v2, 1);
+    ep_encode32(p_mask, mask);
+    size_t n = encode_head(head, ctx.opcode, bytes == size, ctx.inflate, client, bytes, mask);
+    ctx.packet.append(head, n);
 
-    /*append mask*/
-    if (bytes >= 126) {
-      char temp[4] = { 0 };
-      ep_encode16(temp, (u16)bytes);
-      ctx.packet.append(temp, 2);
-    }
-    if (v2 & 0x80) {
-      unsigned int mask = ctx.mask ? make_mask(data, bytes) : 0;
-      ep_encode32(p_mask, mask);
-      ctx.packet.append(p_mask, 4);
-    }
-    /*append size and data*/
+    /*append data*/
     if (bytes > 0) {
-      if ((v2 & 0x80) && ctx.mask) {
+      if (client && ctx.mask) {
         do_convert(data, bytes, ctx, p_mask);
       }
       else {
@@ -2,12 +2,15 @@
 
 #pragma once
 
+#include <mutex>
+
 #include "eport/detail/algo/sha1.hpp"
 #include "eport/detail/algo/base64.hpp"
 #include "eport/detail/io/parser.hpp"
 #include "eport/detail/io/decoder.hpp"
 #include "eport/detail/io/conv.hpp"
-#include "eport/detail/zlib/gzip.hpp"
+#include "eport/detail/io/deflate.hpp"
+#include "eport/detail/io/framer.hpp"
 #include "eport/detail/socket/tcp/socket.hpp"
 
 #ifndef EPORT_ZLIB_ENABLE
@@ -53,6 +56,83 @@ typedef ip::tcp::endpoint endpoint;
 typedef ip::tcp::socket::endpoint_type endpoint_type;
 typedef lowest_socket::value_type socket_type;
 
+/*printable ASCII goes out as a text frame, anything else as binary*/
+inline bool is_text(const char* data, size_t bytes) {
+  for (size_t i = 0; i < bytes; i++) {
+    char c = data[i];
+    if (c < 32 || c > 126) return false;
+  }
+  return true;
+}
+
+/*
+ * One message for many sockets. The payload is copied once, and its server
+ * side frames, plain or deflated without context takeover, are made the
+ * first time a socket asks for them and shared by all the others.
+ */
+class shared_message final {
+  typedef std::vector<lowest_socket::cache_node> frames_type;
+  std::shared_ptr<const std::string> _payload;
+  opcode_type    _opcode;
+  frames_type    _plain, _deflated;
+  std::once_flag _plain_once, _deflated_once;
+
+  shared_message(const char* data, size_t bytes)
+    : _payload(std::make_shared<const std::string>(data, bytes))
+    , _opcode(is_text(data, bytes) ? opcode_type::text : opcode_type::binary) {
+  }
+
+  static frames_type make_frames(const char* data, size_t bytes, std::shared_ptr<const void> hold, opcode_type opcode, bool deflate) {
+    const size_t frame_size = 0xffff;
+    frames_type nodes;
+    do {
+      size_t n = bytes > frame_size ? frame_size : bytes;
+      char head[16];
+      size_t hn = encode_head(head, nodes.empty() ? opcode : opcode_type::frame, n == bytes, nodes.empty() && deflate, false, n, 0);
+      nodes.emplace_back();
+      auto& node = nodes.back();
+      node.head.assign(head, hn);
+      node.data = data;
+      node.size = n;
+      node.hold = hold;
+      data  += n;
+      bytes -= n;
+    } while (bytes > 0);
+    return nodes;
+  }
+
+public:
+  typedef std::shared_ptr<shared_message> value_type;
+  static value_type create(const char* data, size_t bytes) {
+    return value_type(new shared_message(data, bytes));
+  }
+
+  inline const char* data() const { return _payload->c_str(); }
+  inline size_t size() const { return _payload->size(); }
+  inline std::shared_ptr<const void> hold() const { return _payload; }
+
+  /*safe to call from the threads of all the sockets*/
+  const frames_type& frames(bool deflate) {
+    if (deflate) {
+      std::call_once(_deflated_once, [this]() {
+        zlib::deflater deflater;
+        deflater.init(15, 8, false);
+        auto zipped = std::make_shared<std::string>();
+        if (deflater.compress(data(), size(), *zipped)) {
+          _deflated = make_frames(zipped->c_str(), zipped->size(), zipped, _opcode, true);
+        }
+      });
+      if (!_deflated.empty()) {
+        return _deflated;
+      }
+    }
+    std::call_once(_plain_once, [this]() {
+      _plain = make_frames(data(), size(), _payload, _opcode, false);
+    });
+    return _plain;
+  }
+};
+
 class stream final
   : public std::enable_shared_from_this<stream>
 {
@@ -120,14 +200,6 @@ class stream final
     );
   }
 
-  static bool is_text(const char* data) {
-    while (*data) {
-      char c = *data++;
-      if (c < 32 || c > 126) return false;
-    }
-    return true;
-  }
-
   void handshake_ok() {
     _handshaked = true;
     auto lowest = lowest_layer();
@@ -148,10 +220,12 @@ class stream final
       std::string unziped;
 
       if (inflate) {
-        if (zlib::inflate(data, unziped)) {
-          pdata = unziped.c_str();
-          bytes = unziped.size();
+        if (!_codec.decompress(pdata, bytes, unziped, MAX_WS_PACKAGE)) {
+          close();
+          return;
         }
+        pdata = unziped.c_str();
+        bytes = unziped.size();
       }
 
       switch (opcode) {
@@ -179,15 +253,33 @@ class stream final
     });
   }
 
-  void on_decode(const error_code& ec, size_t n, const recv_handler& handler) {
+  bool do_split(size_t n, const recv_handler& handler) {
+    return _framer.feed(_buffer, n, [&](const char* data, size_t bytes) {
+      pcall(handler, no_error(), data, bytes);
+    });
+  }
+
+  void on_decode(const error_code& ec, size_t n, size_t epoch, const recv_handler& handler) {
+    if (epoch != _epoch.load()) {
+      /*a receive of the owner before detach, the stream is not its any more*/
+      pcall(handler, error::operation_aborted, nullptr, 0);
+      return;
+    }
     _recving = false;
+    _surplus = 0;
     if (ec) {
       pcall(handler, ec, nullptr, 0);
       return;
     }
 
     if (!is_websocket()) {
-      pcall(handler, ec, _buffer, n);
+      if (!_framer.enabled()) {
+        pcall(handler, ec, _buffer, n);
+      }
+      else if (!do_split(n, handler)) {
+        pcall(handler, error::message_size, nullptr, 0); /*bad frame*/
+        return;
+      }
     }
 
     else if (!do_decode(n, handler)) {
@@ -294,9 +386,7 @@ class stream final
 
     auto ext = res.get_header(HTTP_HSEC_WEBSOCKET_EXTENSIONS);
     if (!ext.empty()) {
-      if (ext.find("permessage-deflate") == 0) {
-        _deflate = true;
-      }
+      _deflate = _codec.confirm(ext);
     }
 
     if (!ec_new) {
@@ -418,8 +508,8 @@ class stream final
     req.set_header(HTTP_HSEC_WEBSOCKET_VERSION, _version);
     req.set_header(HTTP_HWEBSOCKET_MASK, "disable");
 
-    if (inflate) {
-      req.set_header(HTTP_HSEC_WEBSOCKET_EXTENSIONS, "permessage-deflate; client_max_window_bits");
+    if (inflate && _codec.options().enable) {
+      req.set_header(HTTP_HSEC_WEBSOCKET_EXTENSIONS, _codec.offer());
     }
     return req.to_string();
   }
@@ -461,9 +551,9 @@ class stream final
       }
 
       if (inflate) {
-        auto ext = req.get_header(HTTP_HSEC_WEBSOCKET_EXTENSIONS);
-        if (ext.find("permessage-deflate") == 0) {
-          res.set_header(HTTP_HSEC_WEBSOCKET_EXTENSIONS, "permessage-deflate; client_no_context_takeover; server_max_window_bits=15");
+        auto ext = _codec.accept(req.get_header(HTTP_HSEC_WEBSOCKET_EXTENSIONS));
+        if (!ext.empty()) {
+          res.set_header(HTTP_HSEC_WEBSOCKET_EXTENSIONS, ext);
         }
         else {
           inflate = false;
@@ -477,7 +567,7 @@ class stream final
     return res.to_string();
   }
 
-  void check_request(bool inflate, error_code& ec) {
+  void check_request(error_code& ec) {
     http::request& req = _request;
     while (!ec) {
       size_t n = lowest_layer()->receive(_buffer, sizeof(_buffer), ec);
@@ -555,41 +645,47 @@ class stream final
 
     auto ext = res.get_header(HTTP_HSEC_WEBSOCKET_EXTENSIONS);
     if (!ext.empty()) {
-      if (ext.find("permessage-deflate") == 0) {
-        _deflate = true;
-      }
+      _deflate = _codec.confirm(ext);
     }
   }
 
   endpoint_type dns(const char* host, unsigned short port, error_code& ec) {
-    endpoint_type unknown;
-    auto result = ip::tcp::resolve(host, port, ec);
+    auto list = ip::dns::instance().resolve(host, ec);
     if (ec) {
-      return unknown;
-    }
-
-    int n = (int)result.size();
-    if (n == 0) {
-      ec = error::host_not_found;
-      return unknown;
+      return endpoint_type();
     }
+    return endpoint_type(ip::dns::pick(list), port);
+  }
 
-    if (n == 1) {
-      return *result.begin();
-    }
+  /*tls servers behind one address pick the certificate by this name*/
+  void set_hostname(const char* host) {
+    error_code ec;
+    ip::make_address(host, ec);
+    lowest_layer()->set_hostname(host, !ec);
+  }
 
-    int rnd = (int)(clock::milliseconds() % n);
-    for (auto iter = result.begin(); iter != result.end(); iter++) {
-      if ((--n) == 0) {
-        return *iter;
+  /*Handler: void (const error_code& ec), the name is looked up off the loop*/
+  template<typename ConnectHandler>
+  void async_dns_connect(const char* host, unsigned short port, bool inflate, ConnectHandler&& handler) {
+    assert(host);
+    _host = host;
+    set_hostname(host);
+    auto self = shared_from_this();
+    std::function<void(const error_code&)> callback = handler;
+    ip::dns::instance().async_resolve(host, lowest_layer()->get_executor(),
+      [self, port, inflate, callback](const error_code& ec, const ip::dns::addresses& list) {
+        if (ec) {
+          pcall(callback, ec);
+          return;
+        }
+        self->async_connect(endpoint_type(ip::dns::pick(list), port), inflate, callback);
       }
-    }
-    return unknown;
+    );
   }
 
-  void handshake_s(bool inflate, error_code& ec) {
+  void handshake_s(error_code& ec) {
     if (!ec) {
-      check_request(inflate, ec);
+      check_request(ec);
       if (!ec) {
         handshake_ok();
       }
@@ -633,7 +729,7 @@ class stream final
       handshake_c(inflate, ec);
     }
     else {
-      handshake_s(inflate, ec);
+      handshake_s(ec);
     }
   }
 
@@ -737,6 +833,37 @@ public:
     return _upgrade;
   }
 
+  /*permessage-deflate settings, used by the next handshake*/
+  inline bool set_deflate(const deflate_options& options) {
+    if (!is_websocket()) {
+      return false;
+    }
+    _codec.set_options(options);
+    return true;
+  }
+
+  /*split raw tcp/ssl reads into frames, max_size 0 is unlimited*/
+  inline bool set_framing(framing_type type, size_t max_size) {
+    if (is_websocket()) {
+      return false;
+    }
+    _framer.set(type, max_size);
+    return true;
+  }
+
+  /*a new unconnected stream of the same family, certificates,
+    framing, deflate options and watermarks*/
+  value_type fork() const {
+    auto lowest = lowest_layer();
+    auto sslctx = lowest->get_context();
+    auto ios    = lowest->get_executor();
+    auto peer   = sslctx ? create(ios, sslctx, _upgrade) : create(ios, _upgrade);
+    peer->_codec.set_options(_codec.options());
+    peer->_framer.set(_framer.type(), _framer.max_size());
+    peer->lowest_layer()->watermark(lowest->high_watermark(), lowest->low_watermark());
+    return peer;
+  }
+
   inline http::request& request_header() {
     return _request;
   }
@@ -750,6 +877,7 @@ public:
       farewell(1000, "Normal Closure");
     }
     _rcvcache.clear();
+    _framer.clear();
     lowest_layer()->close();
   }
 
@@ -762,6 +890,7 @@ public:
     auto remote = dns(host, port, ec);
     if (!ec) {
       _host = host;
+      set_hostname(host);
       connect(remote, ec);
     }
   }
@@ -775,6 +904,7 @@ public:
     auto remote = dns(host, port, ec);
     if (!ec) {
       _host = host;
+      set_hostname(host);
       connect(remote, inflate, ec);
     }
   }
@@ -805,19 +935,7 @@ public:
   /*Handler: void (const error_code& ec)*/
   template<typename ConnectHandler>
   void async_connect(const char* host, unsigned short port, ConnectHandler&& handler) {
-    assert(host);
-    error_code ec;
-    auto remote = dns(host, port, ec);
-
-    if (!ec) {
-      _host = host;
-      async_connect(remote, handler);
-      return;
-    }
-
-    lowest_layer()->get_executor()->post([ec, handler]() {
-      pcall(handler, ec);
-    });
+    async_dns_connect(host, port, INFLATE_F, handler);
   }
 
   /*Handler: void (const error_code& ec)*/
@@ -829,19 +947,7 @@ public:
   /*Handler: void (const error_code& ec)*/
   template<typename ConnectHandler>
   void async_connect(const char* host, unsigned short port, bool inflate, ConnectHandler&& handler) {
-    assert(host);
-    error_code ec;
-    auto remote = dns(host, port, ec);
-
-    if (!ec) {
-      _host = host;
-      async_connect(remote, inflate, handler);
-      return;
-    }
-
-    lowest_layer()->get_executor()->post([ec, handler]() {
-      pcall(handler, ec);
-    });
+    async_dns_connect(host, port, inflate, handler);
   }
 
   /*Handler: void (const error_code& ec)*/
@@ -891,7 +997,7 @@ public:
     }
 
     auto opcode = opcode_type::binary;
-    if (is_text(data)) {
+    if (is_text(data, bytes)) {
       opcode = opcode_type::text;
     }
 
@@ -901,7 +1007,8 @@ public:
 
     std::string ziped;
     if (deflate) {
-      if (zlib::deflate(data, bytes, ziped)) {
+      deflate = _codec.compress(data, bytes, ziped);
+      if (deflate) {
         data  = ziped.c_str();
         bytes = ziped.size();
       }
@@ -950,14 +1057,26 @@ public:
   /*Handler: void (const error_code& ec, size_t trans)*/
   template<typename WriteHandler>
   void async_send(const char* data, size_t bytes, bool deflate, WriteHandler&& handler) {
+    async_send(data, bytes, std::shared_ptr<const void>(), deflate, handler);
+  }
+
+  /*Handler: void (const error_code& ec, size_t trans), data is not copied while hold keeps it*/
+  template<typename WriteHandler>
+  void async_send(const char* data, size_t bytes, std::shared_ptr<const void> hold, WriteHandler&& handler) {
+    async_send(data, bytes, hold, _deflate, handler);
+  }
+
+  /*Handler: void (const error_code& ec, size_t trans), data is not copied while hold keeps it*/
+  template<typename WriteHandler>
+  void async_send(const char* data, size_t bytes, std::shared_ptr<const void> hold, bool deflate, WriteHandler&& handler) {
     assert(data);
     if (!is_websocket()) {
-      lowest_layer()->async_send(data, bytes, handler);
+      hold ? lowest_layer()->async_send(data, bytes, hold, handler) : lowest_layer()->async_send(data, bytes, handler);
       return;
     }
 
     auto opcode = opcode_type::binary;
-    if (is_text(data)) {
+    if (is_text(data, bytes)) {
       opcode = opcode_type::text;
     }
 
@@ -965,16 +1084,81 @@ public:
       deflate = false;
     }
 
-    std::string ziped;
+    size_t trans = bytes;
     if (deflate) {
-      if (zlib::deflate(data, bytes, ziped)) {
-        data  = ziped.c_str();
-        bytes = ziped.size();
+      auto ziped = std::make_shared<std::string>();
+      deflate = _codec.compress(data, bytes, *ziped);
+      if (deflate) {
+        data  = ziped->c_str();
+        bytes = ziped->size();
+        hold  = ziped;
       }
     }
-    _encoder.encode(data, bytes, opcode, deflate, [&](const std::string& data, opcode_type, bool) {
-      lowest_layer()->async_send(data, handler);
-    });
+
+    /*frame headers go to their own buffer, only masking copies the payload*/
+    bool client = _encoder.is_client();
+    bool masked = client && _encoder.is_masked();
+    if (!hold && !masked) {
+      auto copy = std::make_shared<const std::string>(data, bytes);
+      data = copy->c_str();
+      hold = copy;
+    }
+
+    const size_t frame_size = 0xffff;
+    std::vector<lowest_socket::cache_node> nodes;
+    do {
+      size_t n = bytes > frame_size ? frame_size : bytes;
+      u32 mask = masked ? make_mask(data, n) : 0;
+      char head[16];
+      size_t hn = encode_head(head, nodes.empty() ? opcode : opcode_type::frame, n == bytes, nodes.empty() && deflate, client, n, mask);
+
+      nodes.emplace_back();
+      auto& node = nodes.back();
+      node.head.assign(head, hn);
+      node.size = n;
+      if (masked) {
+        char key[4];
+        context ctx;
+        ep_encode32(key, mask);
+        do_convert(data, n, ctx, key);
+        auto out = std::make_shared<const std::string>(std::move(ctx.packet));
+        node.data = out->c_str();
+        node.hold = out;
+      }
+      else {
+        node.data = data;
+        node.hold = hold;
+      }
+      data  += n;
+      bytes -= n;
+    } while (bytes > 0);
+    lowest_layer()->async_send(std::move(nodes), trans, handler);
+  }
+
+  /*Handler: void (const error_code& ec, size_t trans), false if the socket
+    is above its high watermark or a websocket not handshaked yet*/
+  template<typename WriteHandler>
+  bool async_send(const shared_message::value_type& msg, WriteHandler&& handler) {
+    auto lowest = lowest_layer();
+    auto high = lowest->high_watermark();
+    if (high && lowest->pending() > 0 && lowest->pending() + msg->size() > high) {
+      return false;
+    }
+    if (!is_websocket()) {
+      lowest->async_send(msg->data(), msg->size(), msg->hold(), handler);
+      return true;
+    }
+    if (!_handshaked) {
+      return false;
+    }
+    if (_encoder.is_client() && _encoder.is_masked()) {
+      async_send(msg->data(), msg->size(), msg->hold(), handler);
+      return true;
+    }
+    bool deflate = _deflate && _codec.shareable() && msg->size() >= _codec.options().min_size;
+    auto nodes = msg->frames(deflate);
+    lowest->async_send(std::move(nodes), msg->size(), handler);
+    return true;
   }
 
   void receive(std::string& data, error_code& ec) {
@@ -992,8 +1176,19 @@ public:
       }
 
       if (!is_websocket()) {
-        data.assign(_buffer, n);
-        return;
+        if (!_framer.enabled()) {
+          data.assign(_buffer, n);
+          return;
+        }
+        auto result = do_split(n, [&](const error_code&, const char* pdata, size_t bytes) {
+          _rcvcache.push_back(std::string(pdata, bytes));
+        });
+        if (!result) {
+          _rcvcache.clear();
+          ec = error::message_size;
+          return;
+        }
+        continue;
       }
 
       auto result = do_decode(n, [&](const error_code& ec, const char* pdata, size_t bytes) {
@@ -1022,29 +1217,60 @@ public:
     }
 
     _recving = true;
+    size_t epoch = _epoch.load();
     if (_surplus > 0) {
       lowest_layer()->get_executor()->post(
         std::bind(
-          &stream::on_decode, shared_from_this(), no_error(), _surplus, (recv_handler)handler
+          &stream::on_decode, shared_from_this(), no_error(), _surplus, epoch, (recv_handler)handler
         )
       );
-      _surplus = 0;
       return;
     }
 
     lowest_layer()->async_receive(_buffer, sizeof(_buffer),
       std::bind(
-        &stream::on_decode, shared_from_this(), std::placeholders::_1, std::placeholders::_2, (recv_handler)handler
+        &stream::on_decode, shared_from_this(), std::placeholders::_1, std::placeholders::_2, epoch, (recv_handler)handler
       )
     );
   }
 
+  /*takes the connection away from this thread's io_context, the websocket
+    and framing state stay with the stream until attach() on another one*/
+  void detach(lowest_socket::parcel& out, error_code& ec) {
+    if (is_websocket() && !_handshaked) {
+      ec = error::try_again;
+      return;
+    }
+    lowest_layer()->detach(out, ec);
+    if (!ec) {
+      _epoch++;
+      _recving = false;
+    }
+  }
+
+  /*continues the connection on ios, called on that io_context's thread*/
+  void attach(io_context::value_type ios, lowest_socket::parcel& in, error_code& ec) {
+    auto socket = lowest_socket::attach(ios, in, ec);
+    if (ec) {
+      return;
+    }
+    _socket = socket;
+    if (is_websocket() && is_client()) {
+      _socket->set_alive(
+        std::bind([](stream::value_type self) {
+          self->ping(nullptr, 0);
+        }, shared_from_this())
+      );
+    }
+  }
+
 private:
   socket_type            _socket;
   bool                   _deflate    = false;
   bool                   _recving    = false;
   bool                   _upgrade    = false;
   bool                   _handshaked = false;
+  std::atomic<size_t>    _epoch{0};
   const char*            _version    = "13";
   const void*            _context    = nullptr;
   char                   _buffer[8192];
@@ -1052,6 +1278,8 @@ private:
   std::string            _host;
   encoder                _encoder;
   decoder                _decoder;
+  framer                 _framer;
+  deflate_codec          _codec;
   http::request          _request;
   http::request_parser   _request_parser;
   http::response         _response;
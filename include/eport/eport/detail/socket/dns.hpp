@@ -0,0 +1,223 @@
+
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "eport/detail/io/context.hpp"
+#include "eport/detail/io/thread_pool.hpp"
+#include "eport/detail/os/clock.hpp"
+#include "eport/detail/socket/address.hpp"
+
+/***********************************************************************************/
+namespace eport {
+namespace ip    {
+/***********************************************************************************/
+
+/*
+ * The process-wide name cache. getaddrinfo tells nothing about TTLs, so an
+ * answer is kept for a fixed time and a failure for a shorter one. Everyone
+ * asking for a name while it is looked up waits for that one lookup, and
+ * misses are resolved on threads of their own, never on an event loop. A
+ * blocking resolve that misses looks up on its own thread but still holds
+ * the name pending, so it neither races nor repeats another lookup.
+ */
+class dns final {
+public:
+  typedef std::vector<address> addresses;
+  typedef std::function<void(const error_code&, const addresses&)> resolve_handler;
+
+private:
+  enum { max_entries = 4096, lookup_threads = 2 };
+
+  struct waiter {
+    io_context::value_type ios;
+    resolve_handler handler;
+  };
+
+  struct entry {
+    addresses  list;
+    error_code ec;
+    size_t     expires = 0;
+    bool       pending = false;
+    std::vector<waiter> waiters;
+  };
+
+  std::mutex _mutex;
+  std::condition_variable _done;
+  std::unordered_map<std::string, entry> _entries;
+  size_t _ttl = 60000;
+  size_t _negative_ttl = 5000;
+  io::thread_pool::value_type _pool;
+
+  dns() {
+    _pool = io::thread_pool::create(lookup_threads);
+    _pool->start();
+  }
+
+  static addresses lookup(const std::string& host, error_code& ec) {
+    addresses list;
+    asio::io_context ios;
+    asio::ip::tcp::resolver resolver(ios);
+    auto results = resolver.resolve(host, "0", ec);
+    for (auto& item : results) {
+      auto addr = item.endpoint().address();
+      if (std::find(list.begin(), list.end(), addr) == list.end()) {
+        list.push_back(addr);
+      }
+    }
+    if (!ec && list.empty()) {
+      ec = error::host_not_found;
+    }
+    return list;
+  }
+
+  /*called with the lock held, by the one who set the entry pending*/
+  void store(entry& item, const addresses& list, const error_code& ec) {
+    item.list    = list;
+    item.ec      = ec;
+    item.expires = clock::milliseconds() + (ec ? _negative_ttl : _ttl);
+  }
+
+  /*called with the lock held, names nobody waits for go first*/
+  void shrink() {
+    if (_entries.size() < max_entries) {
+      return;
+    }
+    auto now = clock::milliseconds();
+    for (auto iter = _entries.begin(); iter != _entries.end();) {
+      bool idle = !iter->second.pending && iter->second.expires <= now;
+      iter = idle ? _entries.erase(iter) : std::next(iter);
+    }
+    for (auto iter = _entries.begin(); iter != _entries.end() && _entries.size() >= max_entries;) {
+      iter = !iter->second.pending ? _entries.erase(iter) : std::next(iter);
+    }
+  }
+
+  /*ends a pending lookup, the entry is never erased while pending*/
+  void finish(const std::string& host, const addresses& list, const error_code& ec) {
+    std::vector<waiter> waiters;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      auto& item = _entries[host];
+      store(item, list, ec);
+      item.pending = false;
+      waiters.swap(item.waiters);
+    }
+    _done.notify_all();
+    for (auto& one : waiters) {
+      auto handler = one.handler;
+      one.ios->post([handler, ec, list]() {
+        pcall(handler, ec, list);
+      });
+    }
+  }
+
+  void on_lookup(const std::string& host) {
+    error_code ec;
+    auto list = lookup(host, ec);
+    finish(host, list, ec);
+  }
+
+public:
+  static dns& instance() {
+    static dns* _self = new dns();
+    return *_self;
+  }
+
+  /*several addresses are taken in turns*/
+  static address pick(const addresses& list) {
+    static std::atomic<size_t> _next{0};
+    return list.empty() ? address() : list[_next++ % list.size()];
+  }
+
+  /*in ms, 0 turns the cache off*/
+  void set_ttl(size_t ttl, size_t negative_ttl) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _ttl = ttl;
+    _negative_ttl = negative_ttl;
+  }
+
+  void clear() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (auto iter = _entries.begin(); iter != _entries.end();) {
+      iter = !iter->second.pending ? _entries.erase(iter) : std::next(iter);
+    }
+  }
+
+  /*blocks on a miss, for the callers that have to*/
+  addresses resolve(const std::string& host, error_code& ec) {
+    auto addr = make_address(host, ec);
+    if (!ec) {
+      return addresses(1, addr);
+    }
+    ec.clear();
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      auto iter = _entries.find(host);
+      if (iter != _entries.end() && iter->second.pending) {
+        _done.wait(lock, [this, &host]() {
+          auto iter = _entries.find(host);
+          return iter == _entries.end() || !iter->second.pending;
+        });
+        iter = _entries.find(host);
+        if (iter != _entries.end()) {
+          ec = iter->second.ec;
+          return iter->second.list;
+        }
+      }
+      if (iter != _entries.end() && clock::milliseconds() < iter->second.expires) {
+        ec = iter->second.ec;
+        return iter->second.list;
+      }
+      shrink();
+      _entries[host].pending = true;
+    }
+    auto list = lookup(host, ec);
+    finish(host, list, ec);
+    return list;
+  }
+
+  /*handler runs on ios, at once for numbers and cached names*/
+  void async_resolve(const std::string& host, io_context::value_type ios, const resolve_handler& handler) {
+    error_code ec;
+    auto addr = make_address(host, ec);
+    if (!ec) {
+      addresses list(1, addr);
+      ios->post([handler, list]() {
+        pcall(handler, no_error(), list);
+      });
+      return;
+    }
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      auto iter = _entries.find(host);
+      if (iter != _entries.end() && !iter->second.pending && clock::milliseconds() < iter->second.expires) {
+        auto list = iter->second.list;
+        ec = iter->second.ec;
+        lock.unlock();
+        ios->post([handler, ec, list]() {
+          pcall(handler, ec, list);
+        });
+        return;
+      }
+      shrink();
+      auto& item = _entries[host];
+      item.waiters.push_back({ ios, handler });
+      if (item.pending) {
+        return;
+      }
+      item.pending = true;
+    }
+    _pool->get_executor()->post(std::bind(&dns::on_lookup, this, host));
+  }
+};
+
+/***********************************************************************************/
+} //end of namespace ip
+} //end of namespace eport
+/***********************************************************************************/
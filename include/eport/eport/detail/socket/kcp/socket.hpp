@@ -1,14 +1,21 @@
-
-
 #pragma once
 
 #ifdef EPORT_KCP_ENABLE
 
 #define KINTERVAL    10
+#define KKEEPALIVE   10000
 #define KCP_HEADSIZE 24
 
 #include <ikcp.h>
+#include <random>
+#include <unordered_map>
+#include <vector>
 #include "eport/detail/io/context.hpp"
+#include "eport/detail/io/decoder.hpp"
+#include "eport/detail/os/clock.hpp"
+#include "eport/detail/timer/steady_timer.hpp"
+#include "eport/detail/socket/udp/endpoint.hpp"
+#include "eport/detail/socket/udp/socket.hpp"
 
 /***********************************************************************************/
 namespace eport {
@@ -20,34 +27,120 @@ enum struct event_type {
   send, receive, error
 };
 
+/*windows in packets, mtu in bytes, interval in ms, the rest as ikcp_nodelay*/
+struct options {
+  int snd_wnd  = 64;
+  int rcv_wnd  = 256;
+  int mtu      = 1400;
+  int interval = KINTERVAL;
+  int nodelay  = 1;
+  int resend   = 2;
+  int nc       = 1;
+};
+
+class tunnel;
+
+/*one timer per thread runs ikcp_update for all tunnels of that thread,
+  it fires when the earliest of them is due, idle ones only for keepalive*/
+class scheduler final
+  : public std::enable_shared_from_this<scheduler>
+{
+  typedef std::weak_ptr<tunnel> tunnel_ref;
+
+  io_context::value_type   _ios;
+  steady_timer::value_type _timer;
+  std::vector<tunnel_ref>  _tunnels;
+  bool                     _running;
+  IUINT32                  _due;
+  size_t                   _round; /*wakeups of a timer armed again are ignored*/
+
+  scheduler(io_context::value_type ios)
+    : _ios(ios)
+    , _timer(steady_timer::create(ios))
+    , _running(false)
+    , _due(0)
+    , _round(0) {
+  }
+
+  static inline IUINT32 time_now() {
+    return (IUINT32)clock::milliseconds();
+  }
+
+  void wait(IUINT32 due, IUINT32 now) {
+    _running = true;
+    _due = due;
+    IINT32 delay = (IINT32)(due - now);
+    _timer->expires_after(std::chrono::milliseconds(delay > 0 ? delay : 0));
+    _timer->async_wait(
+      std::bind(&scheduler::on_timer, shared_from_this(), std::placeholders::_1, ++_round)
+    );
+  }
+
+  inline void on_timer(const error_code& ec, size_t round);
+
+public:
+  typedef std::shared_ptr<scheduler> value_type;
+
+  /*the scheduler of the calling thread, which must be the one running ios*/
+  static value_type local(io_context::value_type ios) {
+    static thread_local std::unordered_map<const void*, std::weak_ptr<scheduler>> _locals;
+    auto& item = _locals[ios.get()];
+    auto self = item.lock();
+    if (!self) {
+      self = value_type(new scheduler(ios));
+      item = self;
+    }
+    return self;
+  }
+
+  inline void add(const std::shared_ptr<tunnel>& t);
+
+  /*a tunnel became due at due, the timer is armed earlier if needed*/
+  void schedule(IUINT32 due) {
+    if (!_running || (IINT32)(due - _due) < 0) {
+      wait(due, time_now());
+    }
+  }
+};
+
+/***********************************************************************************/
+
 class tunnel final
   : public std::enable_shared_from_this<tunnel>
 {
   typedef std::shared_ptr<tunnel>  tunnel_t;
   typedef io_context::value_type   ikcp_context;
-  typedef steady_timer::value_type ikcp_timer;
 
   typedef std::function<
     void(event_type, tunnel_t, const char*, size_t)
   > ikcp_handler;
 
   ikcp_context      _service;
-  ikcp_timer        _timer;
+  scheduler::value_type _scheduler;
   ikcpcb*           _ikcp;
   const void*       _context;
-  size_t            _idle;
-  size_t            _next_update;
+  IUINT32           _active;
+  IUINT32           _next_update;
+  int               _interval;
+  bool              _closed;
+  bool              _flushing;
+  bool              _receiving;
+  error_code        _ec;
+  std::string       _packet;
   io::ws::decoder   _decoder;
   io::ws::encoder   _encoder;
   ikcp_handler      _handler;
 
   tunnel(ikcp_context ios, IUINT32 conv, bool stream)
     : _service(ios)
-    , _timer(steady_timer::create(ios))
     , _ikcp(ikcp_create(conv, this))
     , _context(nullptr)
-    , _idle(0)
-    , _next_update(0)
+    , _active(time_now())
+    , _next_update(_active)
+    , _interval(KINTERVAL)
+    , _closed(false)
+    , _flushing(false)
+    , _receiving(true)
   {
     ikcp_setoutput(_ikcp, output);
     ikcp_setmtu   (_ikcp, 1400);
@@ -65,59 +158,31 @@ class tunnel final
     return (IUINT32)clock::milliseconds();
   }
 
-  static int output(const char *buf, int len, ikcpcb *kcp, void *user) {
-    ((tunnel*)user)->on_flush(buf, len);
-    return len;
+  /*nothing queued, in flight, to acknowledge or to announce*/
+  inline bool idle() const {
+    return _ikcp->nsnd_que == 0 && _ikcp->nsnd_buf == 0
+      && _ikcp->ackcount == 0 && _ikcp->probe == 0;
   }
 
-  static void record(const char* log, ikcpcb* kcp, void* user) {
-    printf("KCP> conv:%u, %s\n", kcp->conv, log);
-  }
-
-  void on_timer(const error_code& ec) {
-    if (ec) {
-      on_error(ec.message().c_str());
+  /*activity makes the tunnel due within one interval again*/
+  void wake() {
+    if (_closed || !_scheduler) {
       return;
     }
-
-    if (is_error()) {
-      char err[64];
-      int wsnd = ikcp_waitsnd(_ikcp);
-      snprintf(err, sizeof(err), "send error: %d", wsnd);
-      on_error(err);
-      return;
-    }
-
-    auto now = time_now();
-    while (now > _next_update) {
-      ikcp_update(_ikcp, now);
-      _next_update = ikcp_check(_ikcp, now);
-    }
-
-    auto wsnd = ikcp_waitsnd(_ikcp);
-    if (wsnd != 0) {
-      _idle = 0;
-    }
-    else {
-      _idle++;
-      if (_idle * KINTERVAL >= 10000) {
-        ping(); /* do keepalive */
-      }
+    IUINT32 due = ikcp_check(_ikcp, time_now());
+    if ((IINT32)(due - _next_update) < 0) {
+      _next_update = due;
     }
+    _scheduler->schedule(_next_update);
+  }
 
-    auto expires = _next_update - now;
-    if (expires > KINTERVAL) {
-      expires = KINTERVAL;
-    }
+  static int output(const char *buf, int len, ikcpcb *kcp, void *user) {
+    ((tunnel*)user)->on_flush(buf, len);
+    return len;
+  }
 
-    _timer->expires_after(
-      std::chrono::milliseconds(expires)
-    );
-    _timer->async_wait(
-      std::bind(
-        &tunnel::on_timer, shared_from_this(), std::placeholders::_1
-      )
-    );
+  static void record(const char* log, ikcpcb* kcp, void* user) {
+    printf("KCP> conv:%u, %s\n", kcp->conv, log);
   }
 
   void ping() {
@@ -129,13 +194,19 @@ class tunnel final
     );
   }
 
-  void on_error(const char* err) {
+  void on_error(const error_code& ec) {
+    if (_closed) {
+      return;
+    }
+    _closed = true;
+    _ec = ec;
     _ikcp->state = (IUINT32)-1;
     if (!_handler) {
       return;
     }
+    auto message = error_message(ec);
     pcall(
-      _handler, event_type::error, shared_from_this(), err, 0
+      _handler, event_type::error, shared_from_this(), message.c_str(), message.size()
     );
   }
 
@@ -148,7 +219,11 @@ class tunnel final
     );
   }
 
+  /*everything sent in one loop turn leaves in one ikcp_flush*/
   void on_send(const std::string& packet, bool flush) {
+    if (_closed) {
+      return;
+    }
     const char* data = packet.c_str();
     size_t size = packet.size();
     _encoder.encode(
@@ -161,14 +236,24 @@ class tunnel final
     if (flush) {
       ikcp_flush(_ikcp);
     }
+    else if (!_flushing) {
+      _flushing = true;
+      _service->post(std::bind(&tunnel::on_post_flush, shared_from_this()));
+    }
+    wake();
+  }
+
+  void on_post_flush() {
+    _flushing = false;
+    if (!_closed) {
+      ikcp_flush(_ikcp);
+    }
   }
 
   void on_receive(const char* data, int size) {
     if (size < 1) {
       if (size < 0) {
-        char err[64];
-        snprintf(err, sizeof(err), "receive error: %d", size);
-        on_error(err);
+        on_error(error::message_size);
       }
       return;
     }
@@ -180,7 +265,7 @@ class tunnel final
         if (op != io::ws::opcode_type::binary) {
           return;
         }
-        if (data.empty()) {
+        if (data.empty() || _closed) {
           return;
         }
         pcall(
@@ -189,18 +274,29 @@ class tunnel final
       }
     );
     if (!ok) {
-      char err[64];
-      snprintf(err, sizeof(err), "receive error: %d", size);
-      on_error(err);
+      on_error(error::invalid_argument);
+    }
+  }
+
+  /*messages stay in ikcp until the owner takes them, its window holds the peer back*/
+  void drain() {
+    while (_receiving && !_closed) {
+      int size = ikcp_peeksize(_ikcp);
+      if (size <= 0) {
+        return;
+      }
+      _packet.resize((size_t)size);
+      on_receive(&_packet[0], ikcp_recv(_ikcp, &_packet[0], size));
     }
   }
 
   void on_input(const std::string& packet, bool flush) {
+    if (_closed) {
+      return;
+    }
     int n = ikcp_input(_ikcp, packet.c_str(), (long)packet.size());
     if (n < 0) {
-      char err[64];
-      snprintf(err, sizeof(err), "input error: %d", n);
-      on_error(err);
+      on_error(error::invalid_argument);
       return;
     }
     if (_ikcp->dead_link < 10) {
@@ -209,12 +305,8 @@ class tunnel final
     if (flush) {
       ikcp_flush(_ikcp);
     }
-    int size = ikcp_peeksize(_ikcp);
-    if (size < 0) {
-      return;
-    }
-    char data[4096];
-    on_receive(data, ikcp_recv(_ikcp, data, sizeof(data)));
+    drain();
+    wake();
   }
 
 public:
@@ -240,7 +332,7 @@ public:
   }
 
   virtual void close() {
-    _timer->cancel();
+    _closed = true;
     _ikcp->state = -1;
   }
 
@@ -248,6 +340,14 @@ public:
     return (_ikcp->state == (IUINT32)-1);
   }
 
+  inline bool is_closed() const {
+    return _closed;
+  }
+
+  inline const error_code& last_error() const {
+    return _ec;
+  }
+
   inline ikcpcb* lowest_layer() const {
     return _ikcp;
   }
@@ -260,6 +360,14 @@ public:
     return _ikcp->conv;
   }
 
+  inline int interval() const {
+    return _interval;
+  }
+
+  inline size_t waitsnd() const {
+    return (size_t)ikcp_waitsnd(_ikcp);
+  }
+
   inline void set_client() {
     _decoder.set_client();
     _encoder.set_client();
@@ -269,6 +377,20 @@ public:
     ikcp_setmtu(_ikcp, mtu);
   }
 
+  void set_options(const options& opt) {
+    _interval = opt.interval > 0 ? opt.interval : KINTERVAL;
+    ikcp_setmtu  (_ikcp, opt.mtu);
+    ikcp_wndsize (_ikcp, opt.snd_wnd, opt.rcv_wnd);
+    ikcp_nodelay (_ikcp, opt.nodelay, _interval, opt.resend, opt.nc);
+  }
+
+  /*false holds received messages back until it is set again*/
+  void receiving(bool on) {
+    _receiving = on;
+    drain();
+    wake();
+  }
+
   inline void context(const void* p) {
     _context = p;
   }
@@ -277,11 +399,43 @@ public:
     return _context;
   }
 
+  /*on the thread running the tunnel's context*/
   void bind(const ikcp_handler& handler) {
     assert(handler);
-    error_code ec;
-    on_timer(ec);
     _handler = handler;
+    _scheduler = scheduler::local(_service);
+    _scheduler->add(shared_from_this());
+  }
+
+  inline IUINT32 next_update() const {
+    return _next_update;
+  }
+
+  /*called by the scheduler, false once the tunnel is done*/
+  bool update(IUINT32 now) {
+    if (_closed) {
+      return false;
+    }
+    if (is_error()) {
+      on_error(error::timed_out);
+      return false;
+    }
+    if ((IINT32)(now - _next_update) >= 0) {
+      ikcp_update(_ikcp, now);
+      _next_update = ikcp_check(_ikcp, now);
+    }
+    if (ikcp_waitsnd(_ikcp) != 0) {
+      _active = now;
+    }
+    else if (now - _active >= KKEEPALIVE) {
+      _active = now;
+      ping(); /* do keepalive */
+      _next_update = ikcp_check(_ikcp, now);
+    }
+    if (idle()) {
+      _next_update = _active + KKEEPALIVE;
+    }
+    return !_closed;
   }
 
 public:
@@ -321,6 +475,14 @@ public:
     on_input(data, flush);
   }
 
+  void keepalive(bool flush) {
+    ping();
+    if (flush) {
+      ikcp_flush(_ikcp);
+    }
+    wake();
+  }
+
 public:
   void async_send(const char* data, int size) {
     async_send(data, size, false);
@@ -363,6 +525,438 @@ public:
   }
 };
 
+inline void scheduler::add(const std::shared_ptr<tunnel>& t) {
+  _tunnels.push_back(t);
+  schedule(t->next_update());
+}
+
+/*tunnels that are gone are dropped, the timer stops with the last one*/
+inline void scheduler::on_timer(const error_code& ec, size_t round) {
+  if (round != _round) {
+    return;
+  }
+  _running = false;
+  if (ec) {
+    return;
+  }
+  auto now = time_now();
+  IUINT32 due = now + KKEEPALIVE;
+  size_t alive = 0;
+  /*tunnels added or woken by the handlers are only looked at for their due time*/
+  size_t count = _tunnels.size();
+  for (size_t i = 0; i < count; i++) {
+    auto t = _tunnels[i].lock();
+    if (!t || !t->update(now)) {
+      continue;
+    }
+    _tunnels[alive++] = _tunnels[i];
+  }
+  for (size_t i = count; i < _tunnels.size(); i++) {
+    if (!_tunnels[i].expired()) {
+      _tunnels[alive++] = _tunnels[i];
+    }
+  }
+  _tunnels.resize(alive);
+  for (auto& item : _tunnels) {
+    auto t = item.lock();
+    if (t && (IINT32)(t->next_update() - due) < 0) {
+      due = t->next_update();
+    }
+  }
+  if (alive > 0) {
+    wait(due, now);
+  }
+}
+
+/***********************************************************************************/
+
+/*
+ * A tunnel and the udp socket carrying it: a connected socket of its own
+ * on the client side, the acceptor's socket shared by all peers on the
+ * server side. Messages keep their boundaries, they are framed like
+ * websocket binary messages inside the kcp stream.
+ */
+class socket final
+  : public std::enable_shared_from_this<socket>
+{
+public:
+  typedef std::shared_ptr<socket> value_type;
+  typedef std::function<void(const error_code&, const char*, size_t)> receive_handler;
+  typedef std::function<void(const std::string&)> release_handler;
+
+private:
+  io_context::value_type   _ios;
+  ip::udp::socket::value_type _udp;
+  ip::udp::endpoint        _remote;
+  tunnel::value_type       _tunnel;
+  options                  _options;
+  receive_handler          _handler;
+  release_handler          _release;
+  std::string              _key;
+  error_code               _ec;
+
+  socket(io_context::value_type ios)
+    : _ios(ios) {
+  }
+
+  static IUINT32 new_conv() {
+    static thread_local std::mt19937 rng(std::random_device{}());
+    IUINT32 conv = 0;
+    while (conv == 0) {
+      conv = (IUINT32)rng();
+    }
+    return conv;
+  }
+
+  void start(IUINT32 conv, bool client) {
+    _tunnel = tunnel::create(_ios, conv);
+    _tunnel->set_options(_options);
+    _tunnel->receiving(false);
+    if (client) {
+      _tunnel->set_client();
+    }
+    std::weak_ptr<socket> weak = shared_from_this();
+    _tunnel->bind([weak](event_type what, tunnel::value_type, const char* data, size_t size) {
+      auto self = weak.lock();
+      if (self) {
+        self->on_event(what, data, size);
+      }
+    });
+  }
+
+  void on_event(event_type what, const char* data, size_t size) {
+    switch (what) {
+    case event_type::send:
+      _udp->queue_send(data, size, _release ? &_remote : nullptr);
+      break;
+    case event_type::receive:
+      if (_handler) {
+        auto handler = _handler;
+        pcall(handler, no_error(), data, size);
+      }
+      break;
+    case event_type::error:
+      finish(_tunnel->last_error());
+      break;
+    }
+  }
+
+  void on_datagrams(const error_code& ec, const ip::udp::socket::datagram* items, size_t count) {
+    if (ec) {
+      finish(ec);
+      return;
+    }
+    for (size_t i = 0; i < count && !_ec; i++) {
+      input(items[i].data, items[i].size);
+    }
+  }
+
+  /*the handler hears the reason once, then the tunnel is dropped*/
+  void finish(const error_code& ec) {
+    if (_ec) {
+      return;
+    }
+    _ec = ec;
+    if (_tunnel) {
+      _tunnel->close();
+    }
+    if (_release) {
+      _release(_key);
+    }
+    else if (_udp) {
+      _udp->close();
+    }
+    if (_handler) {
+      auto handler = _handler;
+      _handler = nullptr;
+      auto message = error_message(ec);
+      pcall(handler, ec, message.c_str(), message.size());
+    }
+  }
+
+public:
+  static value_type create(io_context::value_type ios) {
+    return value_type(new socket(ios));
+  }
+
+  /*a peer of an acceptor, release is called with key when it closes*/
+  static value_type create(io_context::value_type ios, ip::udp::socket::value_type udp,
+    const ip::udp::endpoint& remote, IUINT32 conv, const options& opt,
+    const std::string& key, const release_handler& release) {
+    auto self = value_type(new socket(ios));
+    self->_udp     = udp;
+    self->_remote  = remote;
+    self->_options = opt;
+    self->_key     = key;
+    self->_release = release;
+    self->start(conv, false);
+    return self;
+  }
+
+  inline io_context::value_type get_executor() const {
+    return _ios;
+  }
+
+  inline const options& get_options() const {
+    return _options;
+  }
+
+  void set_options(const options& opt) {
+    _options = opt;
+    if (_tunnel) {
+      _tunnel->set_options(opt);
+    }
+  }
+
+  /*no handshake, the first ping makes the acceptor see the peer at once*/
+  void connect(const ip::udp::endpoint& remote, error_code& ec) {
+    if (_tunnel) {
+      ec = error::already_connected;
+      return;
+    }
+    if (_ec) {
+      ec = _ec; /*closed while the name was looked up*/
+      return;
+    }
+    _udp = ip::udp::socket::create(_ios);
+    _udp->connect(remote, ec);
+    if (ec) {
+      return;
+    }
+    _remote = remote;
+    start(new_conv(), true);
+    _tunnel->keepalive(true);
+
+    std::weak_ptr<socket> weak = shared_from_this();
+    _udp->async_receive_batch(64,
+      [weak](const error_code& ec, const ip::udp::socket::datagram* items, size_t count) {
+        auto self = weak.lock();
+        if (self) {
+          self->on_datagrams(ec, items, count);
+        }
+      }
+    );
+  }
+
+  /*a datagram of this tunnel*/
+  void input(const char* data, size_t size) {
+    if (!_tunnel || size < KCP_HEADSIZE) {
+      return;
+    }
+    if (tunnel::getconv(data) != _tunnel->conv()) {
+      return;
+    }
+    _tunnel->input(data, (int)size);
+  }
+
+  /*the handler gets every message, the last call has ec set*/
+  void async_receive(const receive_handler& handler) {
+    auto self = shared_from_this();
+    _ios->dispatch([self, handler]() {
+      if (self->_ec) {
+        auto callback = handler;
+        auto message  = error_message(self->_ec);
+        pcall(callback, self->_ec, message.c_str(), message.size());
+        return;
+      }
+      self->_handler = handler;
+      if (self->_tunnel) {
+        self->_tunnel->receiving(true);
+      }
+    });
+  }
+
+  bool async_send(const char* data, size_t size) {
+    auto t = _tunnel;
+    if (!t || _ec) {
+      return false;
+    }
+    t->async_send(data, (int)size);
+    return true;
+  }
+
+  /*bytes not yet acknowledged, in whole packets*/
+  size_t pending() const {
+    auto t = _tunnel;
+    return t ? t->waitsnd() * (size_t)_options.mtu : 0;
+  }
+
+  ip::udp::endpoint local_endpoint(error_code& ec) const {
+    if (!_udp) {
+      ec = error::not_connected;
+      return ip::udp::endpoint();
+    }
+    return _udp->local_endpoint(ec);
+  }
+
+  ip::udp::endpoint remote_endpoint(error_code& ec) const {
+    if (!_tunnel) {
+      ec = error::not_connected;
+    }
+    return _remote;
+  }
+
+  void close() {
+    auto self = shared_from_this();
+    _ios->dispatch([self]() {
+      self->finish(error::operation_aborted);
+    });
+  }
+};
+
+/***********************************************************************************/
+
+/*
+ * Peers are told apart by their address and conversation id. A datagram
+ * of an unknown pair starts a new peer only if it is the first segment of
+ * a conversation, so retransmissions to a closed peer are dropped. Once
+ * closed, the udp socket stays open until its last peer is gone.
+ */
+class acceptor final
+  : public std::enable_shared_from_this<acceptor>
+{
+public:
+  typedef std::shared_ptr<acceptor> value_type;
+  typedef std::function<void(const error_code&, socket::value_type)> accept_handler;
+
+private:
+  io_context::value_type      _ios;
+  ip::udp::socket::value_type _udp;
+  options                     _options;
+  accept_handler              _handler;
+  std::unordered_map<std::string, std::weak_ptr<socket>> _peers;
+  bool                        _closed;
+
+  acceptor(io_context::value_type ios)
+    : _ios(ios)
+    , _udp(ip::udp::socket::create(ios))
+    , _closed(false) {
+  }
+
+  static std::string peer_key(IUINT32 conv, const ip::udp::endpoint& remote) {
+    std::string key((const char*)&conv, sizeof(conv));
+    key.append((const char*)remote.data(), remote.size());
+    return key;
+  }
+
+  void on_datagrams(const error_code& ec, const ip::udp::socket::datagram* items, size_t count) {
+    if (ec) {
+      on_error(ec);
+      return;
+    }
+    for (size_t i = 0; i < count; i++) {
+      auto& item = items[i];
+      if (item.size < KCP_HEADSIZE) {
+        continue;
+      }
+      IUINT32 conv = tunnel::getconv(item.data);
+      auto key  = peer_key(conv, item.remote);
+      auto iter = _peers.find(key);
+      auto peer = iter != _peers.end() ? iter->second.lock() : socket::value_type();
+      if (peer) {
+        peer->input(item.data, item.size);
+        continue;
+      }
+      if (_closed || tunnel::getsn(item.data) != 0) {
+        continue;
+      }
+      /*peers keep the acceptor, and with it the socket, alive*/
+      auto self = shared_from_this();
+      peer = socket::create(_ios, _udp, item.remote, conv, _options, key,
+        [self](const std::string& key) {
+          self->release(key);
+        }
+      );
+      _peers[key] = peer;
+      peer->input(item.data, item.size);
+      if (_handler) {
+        auto handler = _handler;
+        pcall(handler, no_error(), peer);
+      }
+    }
+  }
+
+  void on_error(const error_code& ec) {
+    auto peers = std::move(_peers);
+    _peers.clear();
+    for (auto& item : peers) {
+      auto peer = item.second.lock();
+      if (peer) {
+        peer->close();
+      }
+    }
+    if (!_closed) {
+      _closed = true;
+      if (_handler) {
+        auto handler = _handler;
+        _handler = nullptr;
+        pcall(handler, ec, socket::value_type());
+      }
+    }
+  }
+
+  void release(const std::string& key) {
+    _peers.erase(key);
+    if (_closed && _peers.empty()) {
+      _udp->close();
+    }
+  }
+
+public:
+  static value_type create(io_context::value_type ios) {
+    return value_type(new acceptor(ios));
+  }
+
+  inline io_context::value_type get_executor() const {
+    return _ios;
+  }
+
+  void listen(const ip::udp::endpoint& local, error_code& ec) {
+    _udp->bind(local, ec);
+  }
+
+  ip::udp::endpoint local_endpoint(error_code& ec) const {
+    return _udp->local_endpoint(ec);
+  }
+
+  /*peers get the options, the handler is called for each new peer*/
+  void async_accept(const options& opt, const accept_handler& handler) {
+    auto self = shared_from_this();
+    _ios->dispatch([self, opt, handler]() {
+      self->_options = opt;
+      self->_handler = handler;
+      std::weak_ptr<acceptor> weak = self;
+      self->_udp->async_receive_batch(64,
+        [weak](const error_code& ec, const ip::udp::socket::datagram* items, size_t count) {
+          auto self = weak.lock();
+          if (self) {
+            self->on_datagrams(ec, items, count);
+          }
+        }
+      );
+    });
+  }
+
+  /*no new peers from now on, the ones accepted keep going*/
+  void close() {
+    auto self = shared_from_this();
+    _ios->dispatch([self]() {
+      if (self->_closed) {
+        return;
+      }
+      self->_closed = true;
+      if (self->_handler) {
+        auto handler = self->_handler;
+        self->_handler = nullptr;
+        pcall(handler, error::operation_aborted, socket::value_type());
+      }
+      if (self->_peers.empty()) {
+        self->_udp->close();
+      }
+    });
+  }
+};
+
 /***********************************************************************************/
 } //end of namespace kcp
 } //end of namespace ip
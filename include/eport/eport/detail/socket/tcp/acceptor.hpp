@@ -18,7 +18,11 @@ class acceptor
 
   identifier _id;
   io_context::value_type _ios;
-  bool _accepting = false;
+  session _spare;
+  size_t _handshakes = 0;   /*batch peers still in their handshake*/
+  error_code _closed;       /*the last batch call, held back for them*/
+  bool _accepting  = false;
+  bool _reuse_port = false;
   typedef asio::ip::tcp::acceptor parent;
   typedef std::function<void(const error_code&, session)> accept_handler;
   typedef std::function<session(void)> stream_alloter;
@@ -38,6 +42,17 @@ class acceptor
         return;
       }
 #endif
+      if (_reuse_port) {
+#ifdef SO_REUSEPORT
+        asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> option(true);
+        set_option(option, ec);
+#else
+        ec = error::operation_not_supported;
+#endif
+        if (ec) {
+          return;
+        }
+      }
       parent::bind(local, ec);
     }
   }
@@ -45,6 +60,80 @@ class acceptor
     session peer, const accept_handler& handler) {
     pcall(handler, ec, peer);
   }
+  void on_batch_peer(const error_code& ec,
+    session peer, const accept_handler& handler) {
+    _handshakes--;
+    pcall(handler, ec, peer);
+    if (_handshakes == 0 && _closed) {
+      auto closed = _closed;
+      _closed.clear();
+      pcall(handler, closed, session());
+    }
+  }
+  void wait_batch(const stream_alloter& alloter, size_t batch,
+    bool inflate, const accept_handler& handler, size_t delay)
+  {
+    auto callback = std::bind(
+      &acceptor::on_readable, shared_from_this(),
+      std::placeholders::_1,
+      alloter, batch, inflate, handler
+    );
+    _accepting = true;
+    if (delay == 0) {
+      parent::async_wait(parent::wait_read, callback);
+      return;
+    }
+    /*the backlog can't be drained right now, e.g. out of descriptors*/
+    auto timer = std::make_shared<asio::steady_timer>(*_ios);
+    timer->expires_after(std::chrono::milliseconds(delay));
+    timer->async_wait(
+      std::bind([callback](const error_code&, std::shared_ptr<asio::steady_timer>) {
+        callback(no_error());
+      }, std::placeholders::_1, timer)
+    );
+  }
+  void on_readable(const error_code& ec, const stream_alloter& alloter,
+    size_t batch, bool inflate, const accept_handler& handler)
+  {
+    _accepting = false;
+    if (ec || !is_open()) {
+      /*the handshakes still running finish before the last call*/
+      _closed = ec ? ec : error::operation_aborted;
+      if (_handshakes == 0) {
+        _closed.clear();
+        pcall(handler, ec ? ec : error::operation_aborted, session());
+      }
+      return;
+    }
+    size_t delay = 0;
+    for (size_t i = 0; i < batch; i++) {
+      if (!_spare) {
+        _spare = alloter();
+      }
+      error_code err;
+      parent::accept(*_spare->lowest_layer(), err);
+      if (err == error::would_block || err == error::try_again) {
+        break;
+      }
+      if (err == error::connection_aborted) {
+        continue;
+      }
+      if (err) {
+        delay = 100;
+        break;
+      }
+      auto peer = _spare;
+      _spare.reset();
+      auto callback = std::bind(
+        &acceptor::on_batch_peer, shared_from_this(),
+        std::placeholders::_1,
+        peer, handler
+      );
+      _handshakes++;
+      peer->on_async_accept(inflate, callback);
+    }
+    wait_batch(alloter, batch, inflate, handler, delay);
+  }
   void on_accept(
     const error_code& ec, session peer, bool inflate,
     const accept_handler& handler)
@@ -73,6 +162,11 @@ public:
   inline int id() const {
     return _id.value();
   }
+  /*every acceptor bound with it on the same port gets a share of the
+    new connections from the kernel, must be set before listen*/
+  inline void reuse_port(bool on) {
+    _reuse_port = on;
+  }
   void listen(const endpoint_type& local, error_code& ec) {
     listen(local, 1024, ec);
   }
@@ -134,6 +228,24 @@ public:
       )
     );
   }
+  /*takes up to batch connections from the backlog whenever it is
+    readable, the alloter makes the peers ahead of time and the one
+    left over waits for the next round, it runs until the acceptor
+    is closed, peers that fail the handshake are reported with ec,
+    the last call has ec set and no peer and comes after every
+    handshake started before the close has finished,
+    Handler: void (const error_code& ec, session peer)*/
+  template <typename AcceptHandler>
+  void async_accept_batch(const stream_alloter& alloter, size_t batch, bool inflate, AcceptHandler&& handler) {
+    error_code ec;
+    auto callback = (accept_handler)handler;
+    parent::non_blocking(true, ec);
+    if (ec) {
+      pcall(callback, ec, session());
+      return;
+    }
+    wait_batch(alloter, batch ? batch : 1, inflate, callback, 0);
+  }
 };
 
 /***********************************************************************************/
@@ -2,6 +2,8 @@
 
 #pragma once
 
+#include <list>
+
 #include "eport/detail/io/context.hpp"
 #include "eport/detail/ssl/context.hpp"
 #include "eport/detail/socket/tcp/endpoint.hpp"
@@ -16,19 +18,72 @@ class acceptor;
 class socket
   : public std::enable_shared_from_this<socket>
   , public asio::ip::tcp::socket
+  , public timing_wheel::watcher
 {
   friend class acceptor;
   typedef asio::ip::tcp::socket parent;
   typedef std::function<void(const error_code&, size_t)> trans_handler;
   typedef std::function<void(const error_code&)> wait_handler;
   typedef std::function<void(void)> alive_handler;
+  typedef std::function<void(void)> drain_handler;
 
-private:
+public:
+  /* one queued write: head and data are gathered by flush, data is
+     referenced, not copied, and hold keeps it alive until written */
   struct cache_node {
-    std::string   data;
+    std::string   head;
+    const char*   data  = nullptr;
+    size_t        size  = 0;
+    size_t        trans = 0;
+    std::shared_ptr<const void> hold;
     trans_handler handler;
+    inline size_t bytes() const { return head.size() + size; }
   };
 
+#ifdef ASIO_HAS_IO_URING_AS_DEFAULT
+  /* with io_uring a receive stays in the kernel after detach and may still
+     take bytes of the connection, they wait here for the next owner */
+  struct handover {
+    std::mutex  mutex;
+    bool        settled = false;
+    std::string unread;
+    std::function<void(void)> resume;
+  };
+#endif
+
+  /* a connection taken out of its io_context by detach(), it closes
+     the descriptor and frees the tls session unless attach() took them */
+  struct parcel {
+    native_handle_type handle = (native_handle_type)-1;
+    protocol_type protocol    = protocol_type::v4();
+    void*  ssl       = nullptr; /*SSL*, one reference is owned here*/
+    ssl::context::value_type ssl_context;
+    size_t timeout   = 0;
+    size_t high      = 0;
+    size_t low       = 0;
+    bool   recipient = true;
+#ifdef ASIO_HAS_IO_URING_AS_DEFAULT
+    std::shared_ptr<handover> carry;
+#endif
+
+    parcel() = default;
+    parcel(const parcel&) = delete;
+    inline ~parcel() {
+#ifdef EPORT_SSL_ENABLE
+      if (ssl) {
+        SSL_free((SSL*)ssl);
+      }
+#endif
+      if (handle != (native_handle_type)-1) {
+        error_code ec;
+        asio::detail::socket_ops::state_type state = 0;
+        asio::detail::socket_ops::close(handle, state, true, ec);
+      }
+    }
+  };
+
+private:
+
   inline void shutdown() {
     _stream ? _stream->shutdown() : void();
   }
@@ -37,49 +92,114 @@ private:
     _stream ? _stream->shutdown(ec) : void();
   }
 
-  void on_timer(const error_code& ec, size_t expires = 0) {
-    if (ec) {
-      return;
-    }
-    if (expires > 0) {
-      _keepalive += expires;
-      if (_keepalive > _timeout) {
-        close(); /*timeout*/
-        return;
-      }
-      if (_alive_handler) {
-        pcall(_alive_handler);
-      }
-    }
-    expires = _timeout / 5;
+  inline size_t revisit() const {
+    size_t expires = _timeout / 5;
     if (expires < 1) {
       expires = 1;
     }
     if (expires > 60) {
       expires = 60;
     }
-    _timer.expires_after(std::chrono::seconds(expires));
-    _timer.async_wait(
-      std::bind(
-        &socket::on_timer, shared_from_this(), std::placeholders::_1, expires
-      )
-    );
+    return expires;
+  }
+
+  /*the wheel of the io_context comes by every revisit() seconds*/
+  size_t on_visit(size_t now) override {
+    if (_detached || _closing || !parent::is_open()) {
+      _watched = false;
+      return 0;
+    }
+    if (now - _active > _timeout) {
+      _watched = false;
+      close(); /*timeout*/
+      return 0;
+    }
+    if (_alive_handler) {
+      pcall(_alive_handler);
+    }
+    return revisit();
+  }
+
+  inline void watch() {
+    if (!_watched) {
+      _watched = true;
+      _active  = _ios->wheel().now();
+      _ios->wheel().watch(shared_from_this(), revisit());
+    }
   }
 
+  inline void touch() {
+    _active = _ios->wheel().now();
+  }
+
+#ifdef ASIO_HAS_IO_URING_AS_DEFAULT
+  /*the old owner's receive is over, what it read goes to the new one*/
+  void settle(size_t bytes) {
+    auto carry = _carry;
+    _carry.reset();
+    if (!carry) {
+      return;
+    }
+    std::function<void(void)> resume;
+    {
+      std::unique_lock<std::mutex> lock(carry->mutex);
+      carry->unread.assign((const char*)_into.data(), bytes);
+      carry->settled = true;
+      resume.swap(carry->resume);
+    }
+    if (resume) {
+      resume();
+    }
+  }
+
+  /*the first receives of an attached socket take what the old owner read,
+    they wait on its thread until that receive is over*/
+  template<typename MutableBufferSequence>
+  bool take_over(const MutableBufferSequence& buffers, const trans_handler& handler) {
+    auto carry = _carry;
+    std::unique_lock<std::mutex> lock(carry->mutex);
+    if (!carry->settled) {
+      auto self = shared_from_this();
+      carry->resume = [self, buffers, handler]() {
+        self->_ios->post([self, buffers, handler]() {
+          self->async_read_some(buffers, handler);
+        });
+      };
+      return true;
+    }
+    if (carry->unread.empty()) {
+      _carry.reset();
+      return false;
+    }
+    size_t bytes = asio::buffer_copy(buffers, asio::buffer(carry->unread));
+    carry->unread.erase(0, bytes);
+    if (carry->unread.empty()) {
+      _carry.reset();
+    }
+    _ios->post(std::bind(&socket::on_receive, shared_from_this(), no_error(), bytes, handler));
+    return true;
+  }
+#endif
+
   socket(io_context::value_type ios)
     : parent(*ios)
-    , _ios(ios)
-    , _timer(*ios) {
+    , _ios(ios) {
   }
 
   socket(io_context::value_type ios, ssl::context::value_type ssl_context)
     : parent(*ios)
     , _ios(ios)
-    , _timer(*ios)
     , _ssl_context(ssl_context)
     , _stream(new ssl::stream<parent&>(*this, *ssl_context)) {
   }
 
+  socket(io_context::value_type ios, ssl::context::value_type ssl_context, void* ssl)
+    : parent(*ios)
+    , _ios(ios)
+    , _ssl_context(ssl_context)
+    , _stream(new ssl::stream<parent&>(*this, (SSL*)ssl)) {
+  }
+
   socket(const socket&) = delete;
 
 public:
@@ -108,18 +228,57 @@ public:
     _timeout = expires;
   }
 
-  inline void set_hostname(const char* name) {
+  /*an address literal is only checked, names also go out as SNI*/
+  inline void set_hostname(const char* name, bool address = false) {
     if (!_stream) {
       return;
     }
     auto sh = _stream->native_handle();
-    SSL_set_tlsext_host_name(sh, name);
+    if (!address) {
+      SSL_set_tlsext_host_name(sh, name);
+    }
+#ifdef EPORT_SSL_ENABLE
+    if (_ssl_context->check_host()) {
+      auto param = SSL_get0_param(sh);
+      address ? X509_VERIFY_PARAM_set1_ip_asc(param, name)
+              : X509_VERIFY_PARAM_set1_host(param, name, 0);
+    }
+#endif
   }
 
   inline void set_alive(const alive_handler& handler) {
     _alive_handler = handler;
   }
 
+  /*bytes queued for sending and not written yet*/
+  inline size_t pending() const {
+    return _pending;
+  }
+
+  /*counts sends posted from other threads and not queued yet*/
+  inline void posting(bool begin) {
+    begin ? ++_posting : --_posting;
+  }
+
+  /*sends are refused above high, the drain handler runs once the
+    queue gets back down to low after it reached high*/
+  inline void watermark(size_t high, size_t low) {
+    _high = high;
+    _low  = low < high ? low : high;
+  }
+
+  inline size_t high_watermark() const {
+    return _high;
+  }
+
+  inline size_t low_watermark() const {
+    return _low;
+  }
+
+  inline void set_drain(const drain_handler& handler) {
+    _drain_handler = handler;
+  }
+
   void bind(const endpoint_type& local, error_code& ec) {
     if (!is_open()) {
       parent::open(local.protocol(), ec);
@@ -213,11 +372,73 @@ public:
     set_option(no_delay, ec);
   }
 
+  /*hands the descriptor and the tls session over to out, must be called
+    on the socket's own thread while nothing is queued for sending, the
+    pending receive ends with operation_aborted*/
+  void detach(parcel& out, error_code& ec) {
+    if (!is_open()) {
+      ec = error::bad_descriptor;
+      return;
+    }
+    if (!_cache.empty() || _posting > 0) {
+      ec = error::try_again;
+      return;
+    }
+#ifdef EPORT_SSL_ENABLE
+    SSL* ssl = _stream ? _stream->native_handle() : nullptr;
+    /*bytes of a tls record waiting in the engine would be lost*/
+    if (ssl && BIO_ctrl_pending(SSL_get_rbio(ssl)) > 0) {
+      ec = error::try_again;
+      return;
+    }
+#endif
+#ifdef ASIO_HAS_IO_URING_AS_DEFAULT
+    /*bytes of the previous owner are not taken yet*/
+    if (_carry) {
+      ec = error::try_again;
+      return;
+    }
+    /*a tls record the kernel hands to the old engine could not be passed on*/
+    if (_stream && _reading) {
+      ec = error::operation_not_supported;
+      return;
+    }
+#endif
+    auto protocol = local_endpoint(ec).protocol();
+    if (ec) {
+      return;
+    }
+    _detached = true;
+#ifdef ASIO_HAS_IO_URING_AS_DEFAULT
+    if (_reading) {
+      _carry = std::make_shared<handover>();
+      out.carry = _carry;
+    }
+#endif
+
+    out.protocol  = protocol;
+    out.handle    = parent::release(ec);
+    out.timeout   = _timeout;
+    out.high      = _high;
+    out.low       = _low;
+    out.recipient = _recipient;
+    out.ssl_context = _ssl_context;
+#ifdef EPORT_SSL_ENABLE
+    if (ssl) {
+      /*the old engine keeps its own reference and bio, the cancelled
+        read completes on them without touching the session*/
+      SSL_up_ref(ssl);
+      SSL_set_bio(ssl, nullptr, nullptr);
+      out.ssl = ssl;
+    }
+#endif
+  }
+
   virtual void close() {
+    if (_detached) {
+      return;
+    }
     error_code ec;
-    try { _timer.cancel(); }
-    catch (...) { }
-
     if (_cache.empty()) {
       shutdown(shutdown_type::shutdown_both, ec);
       parent::close(ec);
@@ -245,6 +466,26 @@ public:
     return value_type(ssl_context ? new socket(ios, ssl_context) : new socket(ios));
   }
 
+  /*a socket of ios that continues the connection in the parcel*/
+  static value_type attach(io_context::value_type ios, parcel& in, error_code& ec) {
+    value_type self(in.ssl ? new socket(ios, in.ssl_context, in.ssl) : new socket(ios));
+    in.ssl = nullptr;
+    self->assign(in.protocol, in.handle, ec);
+    if (ec) {
+      return value_type();
+    }
+    in.handle = (native_handle_type)-1;
+    self->_timeout   = in.timeout;
+    self->_high      = in.high;
+    self->_low       = in.low;
+    self->_recipient = in.recipient;
+#ifdef ASIO_HAS_IO_URING_AS_DEFAULT
+    self->_carry = in.carry;
+    in.carry.reset();
+#endif
+    return self;
+  }
+
 public:
   template<typename ConnectHandler>
   void async_connect(const endpoint_type& remote, ConnectHandler&& handler) {
@@ -272,14 +513,48 @@ public:
 
   template<typename WriteHandler>
   void async_send(const char* data, size_t bytes, WriteHandler&& handler) {
+    std::shared_ptr<const std::string> hold;
+    if (data) {
+      hold = std::make_shared<const std::string>(data, bytes);
+    }
+    async_send(hold ? hold->c_str() : nullptr, bytes, hold, handler);
+  }
+
+  /*data is not copied, hold must keep it alive*/
+  template<typename WriteHandler>
+  void async_send(const char* data, size_t bytes, std::shared_ptr<const void> hold, WriteHandler&& handler) {
+    std::vector<cache_node> nodes(1);
+    if (data) {
+      cache_node& node = nodes.back();
+      node.data = data;
+      node.size = bytes;
+      node.hold = hold;
+    }
+    else {
+      nodes.clear();
+    }
+    async_send(std::move(nodes), bytes, handler);
+  }
+
+  /*the handler is called once, after the last node is written*/
+  template<typename WriteHandler>
+  void async_send(std::vector<cache_node>&& nodes, size_t trans, WriteHandler&& handler) {
     error_code ec;
     size_t size = _cache.size();
+    size_t bytes = 0;
+    for (auto& node : nodes) {
+      bytes += node.bytes();
+    }
 
     if (!is_open()) {
       ec = error::bad_descriptor;
     }
-    else if (!data || size > 1024) {
+    else if (nodes.empty()) {
+      ec = error::no_buffer_space;
+    }
+    else if (_high && size > 0 && _pending + bytes > _high) {
       ec = error::no_buffer_space;
+      _throttled = true;
     }
 
     if (ec) {
@@ -289,11 +564,15 @@ public:
       return;
     }
 
-    cache_node node;
-    node.data.append(data, bytes);
-    node.handler = (trans_handler)handler;
-
-    _cache.push_back(std::move(node));
+    nodes.back().trans = trans;
+    nodes.back().handler = (trans_handler)handler;
+    for (auto& node : nodes) {
+      _cache.push_back(std::move(node));
+    }
+    _pending += bytes;
+    if (_high && _pending >= _high) {
+      _throttled = true;
+    }
     if (size == 0) {
       flush();  /*send begin*/
     }
@@ -317,14 +596,19 @@ public:
       std::placeholders::_1, (wait_handler)handler
     );
 
-    if (_keepalive == 0) {
-      on_timer(no_error());
-    }
+    watch();
     parent::async_wait(what, callback);
   }
 
   template<typename MutableBufferSequence, typename ReadHandler>
   void async_read_some(const MutableBufferSequence& buffers, ReadHandler&& handler) {
+#ifdef ASIO_HAS_IO_URING_AS_DEFAULT
+    if (_carry && take_over(buffers, (trans_handler)handler)) {
+      return;
+    }
+    _reading = true;
+    _into    = *asio::buffer_sequence_begin(buffers);
+#endif
     auto callback = std::bind(
       &socket::on_receive, shared_from_this(),
       std::placeholders::_1,
@@ -332,15 +616,18 @@ public:
       (trans_handler)handler
     );
 
-    if (_keepalive == 0) {
-      on_timer(no_error());
-    }
+    watch();
     _stream ? _stream->async_read_some(buffers, callback) : parent::async_read_some(buffers, callback);
   }
 
+  /*the handler is moved on, a copied write op would copy the whole gathered queue*/
   template<typename ConstBufferSequence, typename Handler>
   void async_write_some(const ConstBufferSequence& buffers, Handler&& handler) {
-    _stream ? _stream->async_write_some(buffers, handler) : parent::async_write_some(buffers, handler);
+    if (_stream) {
+      _stream->async_write_some(buffers, std::forward<Handler>(handler));
+      return;
+    }
+    parent::async_write_some(buffers, std::forward<Handler>(handler));
   }
 
 public:
@@ -351,10 +638,12 @@ public:
       }
 
       const cache_node& front = _cache.front();
-      const auto& data = front.data;
-      size_t size = data.size();
-      on_send(ec, size, front.handler);
+      size_t size = front.bytes();
+      if (front.handler) {
+        on_send(ec, ec ? 0 : front.trans, front.handler);
+      }
 
+      _pending -= size;
       _cache.pop_front();
       if (!ec && bytes >= size) {
         bytes -= size;
@@ -363,7 +652,16 @@ public:
         }
       }
     }
+    bool drained = (!ec && _throttled && _pending <= _low);
     _cache.empty() ? (_closing ? close() : void()) : flush();
+
+    /*after flush, so sends made by the handler queue up behind it*/
+    if (drained) {
+      _throttled = false;
+      if (_drain_handler) {
+        pcall(_drain_handler);
+      }
+    }
   }
 
   void flush() {
@@ -371,8 +669,12 @@ public:
     auto iter = _cache.begin();
 
     for (; iter != _cache.end(); ++iter) {
-      const std::string& data = iter->data;
-      queue.push_back(buffer(data.c_str(), data.size()));
+      if (!iter->head.empty()) {
+        queue.push_back(buffer(iter->head.c_str(), iter->head.size()));
+      }
+      if (iter->size > 0 || iter->head.empty()) {
+        queue.push_back(buffer(iter->data, iter->size));
+      }
     }
 
     if (!queue.empty()) {
@@ -419,28 +721,36 @@ public:
   void on_handshake(const error_code& ec, const wait_handler& handler) {
     pcall(handler, ec);
     if (!ec) {
-      _keepalive = 1;
+      touch();
     }
   }
 
   void on_wait(const error_code& ec, const wait_handler& handler) {
     pcall(handler, ec);
     if (!ec) {
-      _keepalive = 1;
+      touch();
     }
   }
 
   void on_send(const error_code& ec, size_t bytes, const trans_handler& handler) {
     pcall(handler, ec, bytes);
     if (!ec) {
-      _keepalive = 1;
+      touch();
     }
   }
 
   void on_receive(const error_code& ec, size_t bytes, const trans_handler& handler) {
+#ifdef ASIO_HAS_IO_URING_AS_DEFAULT
+    _reading = false;
+    if (_detached) {
+      settle(ec ? 0 : bytes);
+      pcall(handler, error::operation_aborted, 0);
+      return;
+    }
+#endif
     pcall(handler, ec, bytes);
     if (!ec) {
-      _keepalive = 1;
+      touch();
     }
   }
 
@@ -448,14 +758,26 @@ private:
   identifier _id;
   io_context::value_type _ios;
   alive_handler _alive_handler;
-  asio::steady_timer _timer;
+  drain_handler _drain_handler;
   std::list<cache_node> _cache;
+  std::atomic<size_t> _pending{0};
+  std::atomic<int> _posting{0};
+  size_t _high      = 64 * 1024 * 1024;
+  size_t _low       = 32 * 1024 * 1024;
+  bool _throttled   = false;
   ssl::context::value_type _ssl_context;
   ssl::stream<parent&>* _stream = nullptr;
   size_t _timeout   = 300; /*seconds*/
-  size_t _keepalive = 0;
+  size_t _active    = 0; /*wheel seconds of the last activity*/
+  bool _watched     = false;
   bool _closing     = false;
   bool _recipient   = true;
+  bool _detached    = false;
+#ifdef ASIO_HAS_IO_URING_AS_DEFAULT
+  bool _reading     = false;
+  asio::mutable_buffer _into;
+  std::shared_ptr<handover> _carry;
+#endif
 };
 
 /***********************************************************************************/
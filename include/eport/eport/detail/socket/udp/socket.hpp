@@ -2,8 +2,15 @@
 
 #pragma once
 
+#include <deque>
+#include <mutex>
+#include <vector>
 #include "eport/detail/socket/udp/endpoint.hpp"
 
+#ifdef __linux__
+#include <sys/socket.h>
+#endif
+
 /***********************************************************************************/
 namespace eport {
 namespace ip    {
@@ -18,7 +25,21 @@ class socket
   typedef std::function<void(const error_code&, size_t)> trans_handler;
   typedef std::function<void(const error_code&)> wait_handler;
 
+public:
+  struct datagram {
+    const char*   data;
+    size_t        size;
+    endpoint_type remote;
+  };
+  typedef std::function<void(const error_code&, const datagram*, size_t)> batch_handler;
+
 private:
+  struct outgoing {
+    std::string   data;
+    endpoint_type remote;
+    bool          connected;
+  };
+
   socket(io_context::value_type ios)
     : parent(*ios), _ios(ios) {
   }
@@ -31,6 +52,14 @@ public:
   inline int id() const {
     return _id.value();
   }
+  void connect(const endpoint_type& remote, error_code& ec) {
+    if (!is_open()) {
+      parent::open(remote.protocol(), ec);
+    }
+    if (!ec) {
+      parent::connect(remote, ec);
+    }
+  }
   void bind(const endpoint_type& local, error_code& ec) {
     if (!is_open()) {
       parent::open(local.protocol(), ec);
@@ -83,6 +112,27 @@ public:
   io_context::value_type get_executor() const {
     return _ios;
   }
+  /*longer datagrams are truncated by async_receive_batch*/
+  inline void max_datagram(size_t bytes) {
+    _max_size = bytes ? bytes : 1;
+  }
+  /*kernel buffer sizes, 0 keeps the current one, the socket must be open*/
+  void buffers(size_t recv, size_t send, error_code& ec) {
+    if (recv > 0) {
+      set_option(receive_buffer_size((int)recv), ec);
+    }
+    if (!ec && send > 0) {
+      set_option(send_buffer_size((int)send), ec);
+    }
+  }
+  /*bytes queued by queue_send and not sent yet*/
+  inline size_t pending() const {
+    return _queued;
+  }
+  /*queue_send refuses datagrams once this many bytes wait*/
+  inline void watermark(size_t high) {
+    _high = high;
+  }
   virtual void close() {
     if (!is_open()) {
       return;
@@ -158,7 +208,226 @@ public:
     parent::async_receive_from(buffer(data, size), remote, callback);
   }
 
+  /*reads up to max_count datagrams each time the socket is readable,
+    with one recvmmsg on linux, the handler gets them as one batch and
+    runs until the socket is closed or fails, the last call has ec set,
+    Handler: void (const error_code& ec, const datagram* items, size_t count)*/
+  template<typename ReadHandler>
+  void async_receive_batch(size_t max_count, ReadHandler&& handler) {
+    error_code ec;
+    auto callback = (batch_handler)handler;
+    parent::non_blocking(true, ec);
+    if (ec) {
+      pcall(callback, ec, nullptr, 0);
+      return;
+    }
+    max_count = max_count ? max_count : 1;
+    _rbuffer.resize(max_count * _max_size);
+    _items.resize(max_count);
+#ifdef __linux__
+    _msgs.resize(max_count);
+    _iovecs.resize(max_count);
+    _names.resize(max_count);
+    for (size_t i = 0; i < max_count; i++) {
+      _iovecs[i].iov_base = &_rbuffer[i * _max_size];
+      _iovecs[i].iov_len  = _max_size;
+      memset(&_msgs[i], 0, sizeof(mmsghdr));
+      _msgs[i].msg_hdr.msg_iov    = &_iovecs[i];
+      _msgs[i].msg_hdr.msg_iovlen = 1;
+      _msgs[i].msg_hdr.msg_name   = &_names[i];
+    }
+#endif
+    wait_receive(max_count, callback);
+  }
+  /*copies data into the send queue, everything queued in one loop turn
+    goes out together, with sendmmsg on linux, remote is null for a
+    connected socket, false if more than the watermark is queued,
+    may be called from any thread*/
+  bool queue_send(const char* data, size_t bytes, const endpoint_type* remote) {
+    /*the bytes are reserved first, so racing senders can't pass _high*/
+    size_t queued = _queued.load(std::memory_order_relaxed);
+    do {
+      if (queued + bytes > _high) {
+        return false;
+      }
+    } while (!_queued.compare_exchange_weak(queued, queued + bytes));
+    outgoing packet;
+    packet.data.assign(data, bytes);
+    packet.connected = (remote == nullptr);
+    if (remote) {
+      packet.remote = *remote;
+    }
+    bool idle = false;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _inbox.push_back(std::move(packet));
+      idle = !_flushing;
+      _flushing = true;
+    }
+    if (idle) {
+      _ios->post(std::bind(&socket::flush, shared_from_this()));
+    }
+    return true;
+  }
+
 private:
+  void wait_receive(size_t max_count, const batch_handler& handler) {
+    auto callback = std::bind(
+      &socket::on_readable, shared_from_this(),
+      std::placeholders::_1, max_count, handler
+    );
+    parent::async_wait(wait_read, callback);
+  }
+  void on_readable(const error_code& ec, size_t max_count, const batch_handler& handler) {
+    if (ec || !is_open()) {
+      pcall(handler, ec ? ec : error::operation_aborted, nullptr, 0);
+      return;
+    }
+    error_code err;
+    size_t count = receive_batch(max_count, err);
+    if (count > 0) {
+      pcall(handler, no_error(), _items.data(), count);
+    }
+    /*an icmp error of an earlier send must not stop the receiver*/
+    if (err && err != error::would_block && err != error::try_again
+      && err != error::connection_refused) {
+      pcall(handler, err, nullptr, 0);
+      return;
+    }
+    if (!is_open()) {
+      return;
+    }
+    if (count == max_count) {
+      /*more may wait, read on after the other handlers got their turn*/
+      _ios->post(std::bind(&socket::on_readable, shared_from_this(), no_error(), max_count, handler));
+      return;
+    }
+    wait_receive(max_count, handler);
+  }
+  size_t receive_batch(size_t max_count, error_code& ec) {
+#ifdef __linux__
+    for (size_t i = 0; i < max_count; i++) {
+      _msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+    }
+    int n = ::recvmmsg(native_handle(), _msgs.data(), (unsigned int)max_count, MSG_DONTWAIT, nullptr);
+    if (n < 0) {
+      ec = error_code(errno, asio::error::get_system_category());
+      return 0;
+    }
+    for (int i = 0; i < n; i++) {
+      auto& item = _items[i];
+      item.data = &_rbuffer[i * _max_size];
+      item.size = _msgs[i].msg_len;
+      memcpy(item.remote.data(), &_names[i], _msgs[i].msg_hdr.msg_namelen);
+      item.remote.resize(_msgs[i].msg_hdr.msg_namelen);
+    }
+    return (size_t)n;
+#else
+    size_t count = 0;
+    for (; count < max_count; count++) {
+      auto& item = _items[count];
+      item.data = &_rbuffer[count * _max_size];
+      item.size = parent::receive_from(buffer((char*)item.data, _max_size), item.remote, 0, ec);
+      if (ec) {
+        break;
+      }
+    }
+    return count;
+#endif
+  }
+  void flush() {
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      for (auto& packet : _inbox) {
+        _outbox.push_back(std::move(packet));
+      }
+      _inbox.clear();
+      if (_outbox.empty()) {
+        _flushing = false;
+        return;
+      }
+    }
+    if (!is_open()) {
+      drop_all();
+      return;
+    }
+    error_code ec;
+    size_t sent = send_batch(ec);
+    for (size_t i = 0; i < sent; i++) {
+      _queued -= _outbox.front().data.size();
+      _outbox.pop_front();
+    }
+    if (ec == error::would_block || ec == error::try_again) {
+      parent::async_wait(wait_write, std::bind(&socket::on_writable,
+        shared_from_this(), std::placeholders::_1)
+      );
+      return;
+    }
+    if (ec && !_outbox.empty()) {
+      /*udp keeps no order of failures, only this datagram is lost*/
+      _queued -= _outbox.front().data.size();
+      _outbox.pop_front();
+    }
+    _ios->post(std::bind(&socket::flush, shared_from_this()));
+  }
+  void on_writable(const error_code& ec) {
+    ec ? drop_all() : flush();
+  }
+  /*only the dropped bytes leave _queued, senders may be adding to it*/
+  void drop_all() {
+    size_t dropped = 0;
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (auto& packet : _inbox) {
+      dropped += packet.data.size();
+    }
+    for (auto& packet : _outbox) {
+      dropped += packet.data.size();
+    }
+    _inbox.clear();
+    _outbox.clear();
+    _queued -= dropped;
+    _flushing = false;
+  }
+  size_t send_batch(error_code& ec) {
+    if (!is_open()) {
+      ec = error::bad_descriptor;
+      return 0;
+    }
+#ifdef __linux__
+    size_t count = _outbox.size() < 256 ? _outbox.size() : 256;
+    mmsghdr msgs[256];
+    iovec iovecs[256];
+    for (size_t i = 0; i < count; i++) {
+      auto& packet = _outbox[i];
+      iovecs[i].iov_base = (void*)packet.data.data();
+      iovecs[i].iov_len  = packet.data.size();
+      memset(&msgs[i], 0, sizeof(mmsghdr));
+      msgs[i].msg_hdr.msg_iov    = &iovecs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+      if (!packet.connected) {
+        msgs[i].msg_hdr.msg_name    = packet.remote.data();
+        msgs[i].msg_hdr.msg_namelen = (socklen_t)packet.remote.size();
+      }
+    }
+    int n = ::sendmmsg(native_handle(), msgs, (unsigned int)count, MSG_DONTWAIT);
+    if (n < 0) {
+      ec = error_code(errno, asio::error::get_system_category());
+      return 0;
+    }
+    return (size_t)n;
+#else
+    size_t count = 0;
+    for (auto& packet : _outbox) {
+      auto data = buffer(packet.data.data(), packet.data.size());
+      packet.connected ? parent::send(data, 0, ec) : parent::send_to(data, packet.remote, 0, ec);
+      if (ec) {
+        break;
+      }
+      count++;
+    }
+    return count;
+#endif
+  }
   void on_wait(const error_code& ec, const wait_handler& handler) {
     pcall(handler, ec);
   }
@@ -172,6 +441,20 @@ private:
 private:
   identifier _id;
   io_context::value_type _ios;
+  size_t _max_size = 65536;
+  std::vector<char> _rbuffer;
+  std::vector<datagram> _items;
+#ifdef __linux__
+  std::vector<mmsghdr> _msgs;
+  std::vector<iovec> _iovecs;
+  std::vector<sockaddr_storage> _names;
+#endif
+  std::mutex _mutex;
+  std::vector<outgoing> _inbox;
+  std::deque<outgoing> _outbox;
+  std::atomic<size_t> _queued{0};
+  size_t _high = 4 * 1024 * 1024;
+  bool _flushing = false;
 };
 
 /***********************************************************************************/
@@ -25,6 +25,11 @@ public:
   stream(Arg&& arg, asio::ssl::context& ctx)
     : asio::ssl::stream<Stream>(arg, ctx) {
   }
+  /*continues a session taken from another stream*/
+  template <typename Arg>
+  stream(Arg&& arg, SSL* handle)
+    : asio::ssl::stream<Stream>(arg, handle) {
+  }
 };
 
 typedef asio::ssl::stream_base::handshake_type handshake_type;
@@ -33,6 +38,7 @@ class context : public asio::ssl::context {
   typedef asio::ssl::context parent;
   typedef std::function<void(const char*)> sni_callback;
   sni_callback _callback;
+  bool _check_host = false;
 
 private:
   context(method what = ssl::context::tlsv12)
@@ -80,6 +86,21 @@ public:
     }
     return ec;
   }
+  /*trusts the system store, clients also match the server name*/
+  error_code use_default_verify() {
+    error_code ec;
+    set_default_verify_paths(ec);
+    if (!ec) {
+      set_verify_mode(asio::ssl::verify_peer);
+    }
+    return ec;
+  }
+  inline void use_host_check() {
+    _check_host = true;
+  }
+  inline bool check_host() const {
+    return _check_host;
+  }
   error_code use_certificate_chain(const_buffer& chain) {
     error_code ec;
     set_default_verify_paths(ec);
@@ -103,6 +124,19 @@ public:
     SSL_CTX_set_tlsext_servername_arg(handle, this);
     SSL_CTX_set_tlsext_servername_callback(handle, sni_handler);
   }
+  /*server side resumption, the session ids and the ticket keys
+    belong to this context, so it must be shared by the sockets*/
+  void use_session_cache(const std::string& sid, long timeout = 3600) {
+    auto handle = native_handle();
+    size_t size = sid.size();
+    if (size > SSL_MAX_SID_CTX_LENGTH) {
+      size = SSL_MAX_SID_CTX_LENGTH;
+    }
+    SSL_CTX_set_session_cache_mode(handle, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_set_session_id_context(handle, (const unsigned char*)sid.data(), (unsigned int)size);
+    SSL_CTX_set_timeout(handle, timeout);
+    SSL_CTX_clear_options(handle, SSL_OP_NO_TICKET);
+  }
   typedef std::shared_ptr<context> value_type;
   static value_type create(method what = ssl::context::tlsv12) {
     return value_type(new context());
@@ -128,6 +162,13 @@ public:
   inline error_code load_verify_buffer(const const_buffer& ca) {
     return _ec;
   }
+  inline error_code use_default_verify() {
+    return _ec;
+  }
+  inline void use_host_check() {}
+  inline bool check_host() const {
+    return false;
+  }
   inline error_code use_certificate_chain(const char* cert, size_t size) {
     return _ec;
   }
@@ -136,12 +177,14 @@ public:
   }
   inline static value_type create() { return value_type(); }
   inline void use_sni_callback(sni_callback handler, size_t from, const void* argv){}
+  inline void use_session_cache(const std::string& sid, long timeout = 3600) {}
 };
 
 template <typename _Ty>
 class stream final {
 public:
   inline stream(_Ty, context&) {}
+  inline stream(_Ty, void*) {}
   inline void shutdown() {}
   inline void shutdown(error_code& ec) {}
   inline void* native_handle() { return nullptr; }
@@ -0,0 +1,108 @@
+
+
+#pragma once
+
+#include "eport/3rd.hpp"
+#include "eport/detail/error.hpp"
+
+/***********************************************************************************/
+namespace eport {
+/***********************************************************************************/
+
+/*
+ * One coarse wheel per io_context for the idle checks of its sockets. It
+ * turns once a second and only while someone is watched, a tick takes the
+ * watchers of one slot and asks each of them when to come back. Activity
+ * never touches the wheel, a socket just remembers now() and compares at
+ * its next visit. Not thread safe, used on the io_context's own thread.
+ */
+class timing_wheel final {
+public:
+  enum { slots = 64 }; /*longer revisits are cut to slots - 1 seconds*/
+
+  class watcher {
+  public:
+    virtual ~watcher() { }
+    /*seconds until the next visit, 0 leaves the wheel*/
+    virtual size_t on_visit(size_t now) = 0;
+  };
+  typedef std::weak_ptr<watcher> watcher_ptr;
+
+  timing_wheel(asio::io_context& ios)
+    : _timer(ios) {
+  }
+
+  timing_wheel(const timing_wheel&) = delete;
+
+  /*in seconds, only moves forward while the wheel turns*/
+  inline size_t now() const {
+    return _ticking ? _now : clock::seconds();
+  }
+
+  inline size_t size() const {
+    return _count;
+  }
+
+  void watch(const watcher_ptr& one, size_t after) {
+    if (!_ticking) {
+      _now = clock::seconds();
+    }
+    _slots[(_now + clamp(after)) % slots].push_back(one);
+    _count++;
+    if (!_ticking) {
+      _ticking = true;
+      schedule();
+    }
+  }
+
+private:
+  static inline size_t clamp(size_t after) {
+    return after < 1 ? 1 : (after >= slots ? slots - 1 : after);
+  }
+
+  void schedule() {
+    _timer.expires_after(std::chrono::seconds(1));
+    _timer.async_wait(
+      std::bind(&timing_wheel::on_tick, this, std::placeholders::_1)
+    );
+  }
+
+  /*a late tick catches up with the slots it missed*/
+  void on_tick(const error_code& ec) {
+    if (ec) {
+      return;
+    }
+    auto now = clock::seconds();
+    while (_now < now && _count > 0) {
+      ++_now;
+      _due.swap(_slots[_now % slots]);
+      for (auto& item : _due) {
+        auto one = item.lock();
+        size_t after = one ? one->on_visit(_now) : 0;
+        if (after == 0) {
+          _count--;
+          continue;
+        }
+        _slots[(_now + clamp(after)) % slots].push_back(item);
+      }
+      _due.clear();
+    }
+    if (_count == 0) {
+      _ticking = false;
+      return;
+    }
+    schedule();
+  }
+
+private:
+  asio::steady_timer       _timer;
+  std::vector<watcher_ptr> _slots[slots];
+  std::vector<watcher_ptr> _due;
+  size_t _now     = 0;
+  size_t _count   = 0;
+  bool   _ticking = false;
+};
+
+/***********************************************************************************/
+} //end of namespace eport
+/***********************************************************************************/
@@ -3,6 +3,7 @@
 #pragma once
 
 #include <string>
+#include <string.h>
 #ifdef EPORT_ZLIB_ENABLE
 #define	ZLIB_CONST
 #include <zlib.h>
@@ -169,6 +170,150 @@ inline bool do_deflate(const char* data, size_t bytes, bool gzip, std::string& o
   return true;
 }
 
+/*******************************************************************************/
+
+/* raw deflate stream kept across messages, set up on first use */
+class deflater final {
+  deflater(const deflater&) = delete;
+  z_stream _stream;
+  bool _ready    = false;
+  bool _takeover = true;
+  int  _window   = 15;
+  int  _level    = 8;
+
+  bool setup() {
+    memset(&_stream, 0, sizeof(_stream));
+    _stream.zalloc = zmalloc;
+    _stream.zfree  = zfree;
+    _ready = deflateInit2(&_stream,
+      Z_BEST_SPEED, Z_DEFLATED, -_window, _level, Z_DEFAULT_STRATEGY) == Z_OK;
+    return _ready;
+  }
+
+public:
+  deflater() = default;
+  inline ~deflater() {
+    if (_ready) {
+      deflateEnd(&_stream);
+    }
+  }
+
+  /* window_bits 9..15, mem_level 1..9, without takeover every message starts afresh */
+  inline void init(int window_bits, int mem_level, bool takeover) {
+    if (_ready) {
+      deflateEnd(&_stream);
+      _ready = false;
+    }
+    _window   = window_bits;
+    _level    = mem_level;
+    _takeover = takeover;
+  }
+
+  /* out gets the message flushed to a byte boundary, without the 00 00 ff ff tail */
+  bool compress(const char* data, size_t size, std::string& out) {
+    if (!_ready && !setup()) {
+      return false;
+    }
+    _stream.next_in  = (const Bytef*)data;
+    _stream.avail_in = (uInt)size;
+
+    size_t used = 0;
+    out.resize(size / 2 + 64);
+    for (;;) {
+      _stream.next_out  = (Bytef*)&out[used];
+      _stream.avail_out = (uInt)(out.size() - used);
+      int err = ::deflate(&_stream, Z_SYNC_FLUSH);
+      used = out.size() - _stream.avail_out;
+      if (err != Z_OK && err != Z_BUF_ERROR) {
+        deflateReset(&_stream);
+        return false;
+      }
+      if (_stream.avail_out > 0) {
+        break;
+      }
+      out.resize(out.size() * 2);
+    }
+    if (used >= 4 && memcmp(&out[used - 4], "\x00\x00\xff\xff", 4) == 0) {
+      used -= 4;
+    }
+    out.resize(used);
+    if (!_takeover) {
+      deflateReset(&_stream);
+    }
+    return true;
+  }
+};
+
+/*******************************************************************************/
+
+/* raw inflate stream kept across messages, set up on first use */
+class inflater final {
+  inflater(const inflater&) = delete;
+  z_stream _stream;
+  bool _ready = false;
+
+  bool setup() {
+    memset(&_stream, 0, sizeof(_stream));
+    _stream.zalloc = zmalloc;
+    _stream.zfree  = zfree;
+    _ready = inflateInit2(&_stream, -MAX_WBITS) == Z_OK;
+    return _ready;
+  }
+
+  bool feed(const char* data, size_t size, std::string& out, size_t& used, size_t max_size) {
+    _stream.next_in  = (const Bytef*)data;
+    _stream.avail_in = (uInt)size;
+    for (;;) {
+      if (used == out.size()) {
+        out.resize(out.size() * 2);
+      }
+      _stream.next_out  = (Bytef*)&out[used];
+      _stream.avail_out = (uInt)(out.size() - used);
+      int err = ::inflate(&_stream, Z_SYNC_FLUSH);
+      used = out.size() - _stream.avail_out;
+      if (max_size && used > max_size) {
+        return false;
+      }
+      if (err == Z_STREAM_END) {
+        /*the peer closed its stream, the next message starts a new one*/
+        inflateReset(&_stream);
+        return true;
+      }
+      if (err != Z_OK && err != Z_BUF_ERROR) {
+        return false;
+      }
+      if (_stream.avail_out > 0) {
+        /*all input is used and no output is pending*/
+        return _stream.avail_in == 0;
+      }
+    }
+  }
+
+public:
+  inflater() = default;
+  inline ~inflater() {
+    if (_ready) {
+      inflateEnd(&_stream);
+    }
+  }
+
+  /* the history is always kept, which is also right for peers that reset theirs */
+  bool decompress(const char* data, size_t size, std::string& out, size_t max_size = 0) {
+    static const char tail[] = { '\x00', '\x00', '\xff', '\xff' };
+    if (!_ready && !setup()) {
+      return false;
+    }
+    size_t used = 0;
+    out.resize(size * 2 + 64);
+    if (!feed(data, size, out, used, max_size) || !feed(tail, sizeof(tail), out, used, max_size)) {
+      inflateReset(&_stream);
+      return false;
+    }
+    out.resize(used);
+    return true;
+  }
+};
+
 #else
 
 inline bool do_inflate(const char* data, size_t bytes, bool gzip, std::string& out) {
@@ -179,6 +324,17 @@ inline bool do_deflate(const char* data, size_t bytes, bool gzip, std::string& o
   return false;
 }
 
+class deflater final {
+public:
+  inline void init(int window_bits, int mem_level, bool takeover) {}
+  inline bool compress(const char* data, size_t size, std::string& out) { return false; }
+};
+
+class inflater final {
+public:
+  inline bool decompress(const char* data, size_t size, std::string& out, size_t max_size = 0) { return false; }
+};
+
 #endif
 
 /*******************************************************************************/
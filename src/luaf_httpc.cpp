@@ -0,0 +1,720 @@
+
+
+#include <errno.h>
+#include <string.h>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <system_error>
+#include "luaf_httpc.h"
+#include "http-parser/http_parser.h"
+#include "socket.io/socket.io.hpp"
+#include "eport/detail/os/os.hpp"
+
+/********************************************************************************/
+
+/*
+ * io.http.request keeps its connections per job and per scheme://host:port.
+ * A request takes an idle connection, opens a new one below the limit, or
+ * with pipelining goes behind the requests already sent on one (GET and
+ * HEAD only). Otherwise it waits for a connection to come free. Responses
+ * are cut by http_parser and given back in the order they were asked for.
+ */
+
+struct http_call {
+  int rcb   = 0; /* the callback or the yielded coroutine */
+  int rbody = 0; /* on_body, the body is not kept when set */
+  std::string key, host, ca;
+  lws_ushort port = 0;
+  bool secure  = false;
+  bool verify  = true;  /* https checks the server name and certificate */
+  bool head    = false;
+  bool replay  = false; /* can be sent again on another connection */
+  bool retried = false;
+  bool started = false; /* response bytes have arrived */
+  size_t deadline = 0;
+  std::string wire;
+
+  int status = 0;
+  bool in_value = false;
+  std::string field, value, body;
+  std::vector<std::pair<std::string, std::string>> headers;
+};
+
+typedef std::shared_ptr<http_call> call_type;
+
+struct http_conn {
+  lws_int handle = 0;
+  std::string key;
+  bool connected = false;
+  bool closed    = false;
+  size_t served  = 0;
+  size_t idle_since = 0;
+  http_parser parser;
+  std::deque<call_type> inflight;
+};
+
+typedef std::shared_ptr<http_conn> conn_type;
+
+struct http_host {
+  std::vector<conn_type> conns;
+  std::deque<call_type> waiting;
+};
+
+struct http_pool {
+  std::unordered_map<std::string, http_host> hosts;
+  lws_int ticker    = 0;
+  bool    ticking   = false;
+  size_t  max_conns = 8;
+  size_t  pipeline  = 1;
+  size_t  keepalive = 30000;
+};
+
+static thread_local http_pool* local_pool = nullptr;
+
+static http_pool& pool() {
+  if (!local_pool) {
+    local_pool = new http_pool();
+  }
+  return *local_pool;
+}
+
+static void dispatch(const std::string& key);
+static void drop(conn_type conn, int ec, const char* err);
+
+/********************************************************************************/
+
+static int push_response(lua_State* L, const call_type& call, bool streamed) {
+  lua_createtable(L, 0, 3);
+  lua_pushinteger(L, call->status);
+  lua_setfield(L, -2, "status");
+  lua_createtable(L, 0, (int)call->headers.size());
+  for (auto& item : call->headers) {
+    lua_pushlstring(L, item.first.c_str(), item.first.size());
+    if (lua_rawget(L, -2) == LUA_TSTRING) {
+      /* repeated fields are joined as one list */
+      lua_pushstring(L, ", ");
+      lua_pushlstring(L, item.second.c_str(), item.second.size());
+      lua_concat(L, 3);
+    }
+    else {
+      lua_pop(L, 1);
+      lua_pushlstring(L, item.second.c_str(), item.second.size());
+    }
+    lua_setfield(L, -2, item.first.c_str());
+  }
+  lua_setfield(L, -2, "headers");
+  if (!streamed) {
+    lua_pushlstring(L, call->body.c_str(), call->body.size());
+    lua_setfield(L, -2, "body");
+  }
+  return 1;
+}
+
+/* func(0, response) or func(ec, err), a coroutine gets response or nil, err */
+static void deliver(const call_type& call, int ec, const char* err) {
+  lua_State* L = luaC_getlocal();
+  revert_if_return revert(L);
+  unref_if_return  unref_rcb(L, call->rcb);
+  unref_if_return  unref_body(L, call->rbody);
+  int rcb = call->rcb;
+  bool streamed = call->rbody != 0;
+  call->rcb = call->rbody = 0;
+
+  luaC_rawgeti(L, rcb);
+  int type = lua_type(L, -1);
+  if (type == LUA_TTHREAD) {
+    auto coL = lua_tothread(L, -1);
+    if (lua_status(coL) != LUA_YIELD) {
+      return;
+    }
+    int argc = 1;
+    if (ec) {
+      lua_pushnil(coL);
+      lua_pushstring(coL, err);
+      argc = 2;
+    }
+    else {
+      push_response(coL, call, streamed);
+    }
+    int status = lua_resume(coL, L, argc, &argc);
+    if (status != LUA_OK && status != LUA_YIELD) {
+      lua_ferror("%s\n", lua_tostring(coL, -1));
+    }
+    return;
+  }
+  if (type == LUA_TFUNCTION) {
+    lua_pushinteger(L, ec);
+    if (ec) {
+      lua_pushstring(L, err);
+    }
+    else {
+      push_response(L, call, streamed);
+    }
+    if (luaC_xpcall(L, 2, 0) != LUA_OK) {
+      lua_ferror("%s\n", lua_tostring(L, -1));
+    }
+  }
+}
+
+/********************************************************************************/
+
+static int on_message_begin(http_parser* parser) {
+  auto conn = (http_conn*)parser->data;
+  if (conn->inflight.empty()) {
+    return -1;
+  }
+  auto& call = conn->inflight.front();
+  call->started = true;
+  return 0;
+}
+
+static int on_header_field(http_parser* parser, const char* data, size_t size) {
+  auto& call = ((http_conn*)parser->data)->inflight.front();
+  if (call->in_value) {
+    call->headers.emplace_back(call->field, call->value);
+    call->field.clear();
+    call->value.clear();
+    call->in_value = false;
+  }
+  for (size_t i = 0; i < size; i++) {
+    call->field.push_back((char)tolower((unsigned char)data[i]));
+  }
+  return 0;
+}
+
+static int on_header_value(http_parser* parser, const char* data, size_t size) {
+  auto& call = ((http_conn*)parser->data)->inflight.front();
+  call->in_value = true;
+  call->value.append(data, size);
+  return 0;
+}
+
+static int on_headers_complete(http_parser* parser) {
+  auto& call = ((http_conn*)parser->data)->inflight.front();
+  if (call->in_value) {
+    call->headers.emplace_back(call->field, call->value);
+    call->field.clear();
+    call->value.clear();
+    call->in_value = false;
+  }
+  call->status = parser->status_code;
+  return call->head ? 1 : 0; /* a response to HEAD has no body */
+}
+
+static int on_body(http_parser* parser, const char* data, size_t size) {
+  auto& call = ((http_conn*)parser->data)->inflight.front();
+  if (!call->rbody) {
+    call->body.append(data, size);
+    return 0;
+  }
+  lua_State* L = luaC_getlocal();
+  revert_if_return revert(L);
+  luaC_rawgeti(L, call->rbody);
+  if (lua_type(L, -1) == LUA_TFUNCTION) {
+    lua_pushlstring(L, data, size);
+    if (luaC_xpcall(L, 1, 0) != LUA_OK) {
+      lua_ferror("%s\n", lua_tostring(L, -1));
+    }
+  }
+  return 0;
+}
+
+static int on_message_complete(http_parser* parser) {
+  auto& call = ((http_conn*)parser->data)->inflight.front();
+  if (parser->status_code >= 100 && parser->status_code < 200 && parser->status_code != 101) {
+    /* an interim response, the real one follows */
+    call->headers.clear();
+    call->body.clear();
+    return 0;
+  }
+  http_parser_pause(parser, 1);
+  return 0;
+}
+
+static const http_parser_settings settings = {
+  on_message_begin,
+  nullptr,
+  nullptr,
+  on_header_field,
+  on_header_value,
+  on_headers_complete,
+  on_body,
+  on_message_complete,
+  nullptr,
+  nullptr
+};
+
+/********************************************************************************/
+
+static void close_conn(const conn_type& conn) {
+  if (conn->closed) {
+    return;
+  }
+  conn->closed = true;
+  lws::close(conn->handle);
+  auto iter = pool().hosts.find(conn->key);
+  if (iter == pool().hosts.end()) {
+    return;
+  }
+  auto& conns = iter->second.conns;
+  for (auto it = conns.begin(); it != conns.end(); ++it) {
+    if (*it == conn) {
+      conns.erase(it);
+      break;
+    }
+  }
+}
+
+/* the calls still on a broken connection are sent again if they can be */
+static void drop(conn_type conn, int ec, const char* err) {
+  if (conn->closed) {
+    return;
+  }
+  close_conn(conn);
+  std::deque<call_type> calls;
+  calls.swap(conn->inflight);
+  std::vector<call_type> failed;
+  auto& waiting = pool().hosts[conn->key].waiting;
+  auto now = luaC_clock();
+  for (auto iter = calls.rbegin(); iter != calls.rend(); ++iter) {
+    auto& call = *iter;
+    bool reuse = conn->served > 0 || iter != calls.rend() - 1;
+    if (call->replay && reuse && !call->started && !call->retried && now < call->deadline) {
+      call->retried = true;
+      waiting.push_front(call);
+      continue;
+    }
+    failed.push_back(call);
+  }
+  dispatch(conn->key);
+  for (auto iter = failed.rbegin(); iter != failed.rend(); ++iter) {
+    bool expired = now >= (*iter)->deadline;
+    deliver(*iter, expired ? ETIMEDOUT : ec, expired ? "timed out" : err);
+  }
+}
+
+static void send_call(const conn_type& conn, const call_type& call) {
+  lws_int ok = lws::sendref(conn->handle, call->wire.c_str(), call->wire.size(), [call](int, lws_size) {});
+  if (ok != lws_true) {
+    drop(conn, ECONNRESET, "connection closed");
+  }
+}
+
+/* one response is complete, false once the connection is gone */
+static bool finish(const conn_type& conn) {
+  auto call = conn->inflight.front();
+  conn->inflight.pop_front();
+  conn->served++;
+  bool keep = http_should_keep_alive(&conn->parser) != 0;
+  if (!keep) {
+    drop(conn, ECONNRESET, "connection closed");
+  }
+  else if (conn->inflight.empty()) {
+    conn->idle_since = luaC_clock();
+    dispatch(conn->key);
+  }
+  deliver(call, 0, nullptr);
+  return !conn->closed;
+}
+
+static void feed(const conn_type& conn, const char* data, size_t size) {
+  size_t offset = 0;
+  do {
+    if (conn->inflight.empty()) {
+      drop(conn, EPROTO, "unexpected data");
+      return;
+    }
+    offset += http_parser_execute(&conn->parser, &settings, data + offset, size - offset);
+    auto error = HTTP_PARSER_ERRNO(&conn->parser);
+    if (error == HPE_PAUSED) {
+      http_parser_pause(&conn->parser, 0);
+      if (!finish(conn)) {
+        return;
+      }
+      continue;
+    }
+    if (error != HPE_OK) {
+      drop(conn, EPROTO, http_errno_description(error));
+      return;
+    }
+  } while (offset < size);
+}
+
+/* a response without length ends with the connection */
+static void on_eof(const conn_type& conn) {
+  if (!conn->inflight.empty() && conn->inflight.front()->started) {
+    http_parser_execute(&conn->parser, &settings, nullptr, 0);
+    if (HTTP_PARSER_ERRNO(&conn->parser) == HPE_PAUSED) {
+      http_parser_pause(&conn->parser, 0);
+      if (!finish(conn)) {
+        return;
+      }
+    }
+  }
+  drop(conn, ECONNRESET, "connection closed");
+}
+
+static void open_conn(const call_type& call) {
+  auto conn = std::make_shared<http_conn>();
+  conn->key = call->key;
+  http_parser_init(&conn->parser, HTTP_RESPONSE);
+  conn->parser.data = conn.get();
+
+  lws_cainfo info;
+  memset(&info, 0, sizeof(info));
+  info.caf      = call->ca.empty() ? nullptr : call->ca.c_str();
+  info.caf_size = call->ca.size();
+  info.verify   = call->verify ? lws_true : lws_false;
+  conn->handle = lws::socket(call->secure ? lws_family::ssl : lws_family::tcp, call->verify ? &info : nullptr);
+  if (conn->handle <= 0) {
+    deliver(call, ENOTSUP, "https is not supported by this build");
+    return;
+  }
+  conn->inflight.push_back(call);
+  pool().hosts[conn->key].conns.push_back(conn);
+
+  lws::connect(conn->handle, call->host.c_str(), call->port, [conn](int ec) {
+    if (conn->closed) {
+      return;
+    }
+    if (ec) {
+      drop(conn, ec, std::system_category().message(ec).c_str());
+      return;
+    }
+    conn->connected = true;
+    lws::receive(conn->handle, [conn](int ec, const char* data, lws_size size) {
+      if (conn->closed) {
+        return;
+      }
+      ec ? on_eof(conn) : feed(conn, data, size);
+    });
+    auto calls = conn->inflight;
+    for (auto& one : calls) {
+      send_call(conn, one);
+    }
+  });
+}
+
+static void on_tick(int ec);
+
+static void arm_ticker() {
+  auto& self = pool();
+  if (self.ticking) {
+    return;
+  }
+  if (self.ticker == 0) {
+    self.ticker = lws::timer();
+  }
+  self.ticking = lws::expires(self.ticker, 100, on_tick) == lws_true;
+}
+
+/* expires requests and idle connections every 100 ms while there are any */
+static void on_tick(int ec) {
+  auto& self = pool();
+  self.ticking = false;
+  if (ec) {
+    return;
+  }
+  auto now = luaC_clock();
+  std::vector<call_type> expired;
+  std::vector<conn_type> stale, idle;
+  for (auto iter = self.hosts.begin(); iter != self.hosts.end();) {
+    auto& host = iter->second;
+    for (auto it = host.waiting.begin(); it != host.waiting.end();) {
+      if (now >= (*it)->deadline) {
+        expired.push_back(*it);
+        it = host.waiting.erase(it);
+        continue;
+      }
+      ++it;
+    }
+    for (auto& conn : host.conns) {
+      if (conn->inflight.empty()) {
+        if (now - conn->idle_since >= self.keepalive) {
+          idle.push_back(conn);
+        }
+        continue;
+      }
+      for (auto& call : conn->inflight) {
+        if (now >= call->deadline) {
+          stale.push_back(conn);
+          break;
+        }
+      }
+    }
+    if (host.conns.empty() && host.waiting.empty()) {
+      iter = self.hosts.erase(iter);
+      continue;
+    }
+    ++iter;
+  }
+  for (auto& conn : idle) {
+    close_conn(conn);
+  }
+  for (auto& conn : stale) {
+    drop(conn, ETIMEDOUT, "timed out");
+  }
+  for (auto& call : expired) {
+    deliver(call, ETIMEDOUT, "timed out");
+  }
+  if (!self.hosts.empty()) {
+    arm_ticker();
+  }
+}
+
+static void dispatch(const std::string& key) {
+  auto& self = pool();
+  while (true) {
+    auto iter = self.hosts.find(key);
+    if (iter == self.hosts.end() || iter->second.waiting.empty()) {
+      return;
+    }
+    auto& host = iter->second;
+    auto  call = host.waiting.front();
+    conn_type target;
+    for (auto& conn : host.conns) {
+      if (conn->connected && conn->inflight.empty()) {
+        target = conn;
+        break;
+      }
+    }
+    if (!target && host.conns.size() >= self.max_conns && self.pipeline > 1 && call->replay) {
+      for (auto& conn : host.conns) {
+        auto size = conn->inflight.size();
+        if (conn->connected && size < self.pipeline && conn->inflight.back()->replay) {
+          if (!target || size < target->inflight.size()) {
+            target = conn;
+          }
+        }
+      }
+    }
+    host.waiting.pop_front();
+    if (target) {
+      target->inflight.push_back(call);
+      send_call(target, call);
+      continue;
+    }
+    if (host.conns.size() < self.max_conns) {
+      open_conn(call);
+      continue;
+    }
+    host.waiting.push_front(call);
+    return;
+  }
+}
+
+/********************************************************************************/
+
+static bool parse_url(const char* url, size_t size, const call_type& call, std::string& target) {
+  struct http_parser_url parts;
+  http_parser_url_init(&parts);
+  if (http_parser_parse_url(url, size, 0, &parts) != 0) {
+    return false;
+  }
+  if (!(parts.field_set & (1 << UF_SCHEMA)) || !(parts.field_set & (1 << UF_HOST))) {
+    return false;
+  }
+  std::string schema(url + parts.field_data[UF_SCHEMA].off, parts.field_data[UF_SCHEMA].len);
+  for (auto& c : schema) {
+    c = (char)tolower((unsigned char)c);
+  }
+  if (schema != "http" && schema != "https") {
+    return false;
+  }
+  call->secure = (schema == "https");
+  call->host.assign(url + parts.field_data[UF_HOST].off, parts.field_data[UF_HOST].len);
+  call->port = parts.port ? parts.port : (call->secure ? 443 : 80);
+
+  target = "/";
+  if (parts.field_set & (1 << UF_PATH)) {
+    target.assign(url + parts.field_data[UF_PATH].off, parts.field_data[UF_PATH].len);
+  }
+  if (parts.field_set & (1 << UF_QUERY)) {
+    target += '?';
+    target.append(url + parts.field_data[UF_QUERY].off, parts.field_data[UF_QUERY].len);
+  }
+  return true;
+}
+
+/* a header line can't carry another one */
+static bool check_header(const char* data, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    if (data[i] == '\r' || data[i] == '\n' || data[i] == '\0') {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* fills the call from { method, url, headers, body, timeout, ca, verify, on_body } */
+static const char* check_request(lua_State* L, int index, const call_type& call) {
+  luaL_checktype(L, index, LUA_TTABLE);
+  lua_getfield(L, index, "url");
+  size_t size = 0;
+  const char* url = luaL_optlstring(L, -1, nullptr, &size);
+  std::string target;
+  if (!url || !parse_url(url, size, call, target)) {
+    return "invalid url";
+  }
+  lua_getfield(L, index, "body");
+  size_t body_size = 0;
+  const char* body = luaL_optlstring(L, -1, nullptr, &body_size);
+  lua_getfield(L, index, "method");
+  std::string method = luaL_optstring(L, -1, body ? "POST" : "GET");
+  for (auto& c : method) {
+    c = (char)toupper((unsigned char)c);
+  }
+  if (method.empty() || method.find_first_of(" \r\n") != std::string::npos) {
+    lua_pop(L, 3);
+    return "invalid method";
+  }
+  lua_getfield(L, index, "timeout");
+  lua_Integer timeout = luaL_optinteger(L, -1, 30000);
+  luaL_argcheck(L, timeout > 0, index, "timeout must be > 0");
+  lua_getfield(L, index, "ca");
+  size_t ca_size = 0;
+  const char* ca = luaL_optlstring(L, -1, nullptr, &ca_size);
+  lua_getfield(L, index, "verify");
+  call->verify = lua_isnil(L, -1) || lua_toboolean(L, -1);
+  lua_pop(L, 6);
+
+  call->head     = (method == "HEAD");
+  call->replay   = (method == "GET" || call->head);
+  call->deadline = luaC_clock() + (size_t)timeout;
+  if (ca && call->verify) {
+    call->ca.assign(ca, ca_size);
+  }
+  char port[8];
+  snprintf(port, sizeof(port), "%d", (int)call->port);
+  call->key = (call->secure ? "https://" : "http://") + call->host + ':' + port;
+  if (!call->ca.empty()) {
+    call->key += '#' + std::to_string(std::hash<std::string>()(call->ca));
+  }
+  if (call->secure && !call->verify) {
+    call->key += "#noverify";
+  }
+
+  std::string& wire = call->wire;
+  wire.reserve(256 + body_size);
+  wire = method + ' ' + target + " HTTP/1.1\r\n";
+  bool has_host = false;
+  if (lua_getfield(L, index, "headers") == LUA_TTABLE) {
+    lua_pushnil(L);
+    while (lua_next(L, -2)) {
+      if (lua_type(L, -2) == LUA_TSTRING && lua_isstring(L, -1)) {
+        size_t name_size = 0, value_size = 0;
+        const char* name  = lua_tolstring(L, -2, &name_size);
+        const char* value = lua_tolstring(L, -1, &value_size);
+        if (name_size == 0 || !check_header(name, name_size) || !check_header(value, value_size)) {
+          lua_pop(L, 3);
+          return "invalid header";
+        }
+        if (stricmp(name, "content-length") != 0) {
+          has_host = has_host || stricmp(name, "host") == 0;
+          wire += name;
+          wire += ": ";
+          wire.append(value, value_size);
+          wire += "\r\n";
+        }
+      }
+      lua_pop(L, 1);
+    }
+  }
+  lua_pop(L, 1);
+  if (!has_host) {
+    bool usual = call->port == (call->secure ? 443 : 80);
+    wire += "Host: " + call->host + (usual ? "" : std::string(":") + port) + "\r\n";
+  }
+  if (body || method == "POST" || method == "PUT" || method == "PATCH") {
+    wire += "Content-Length: " + std::to_string(body_size) + "\r\n";
+  }
+  wire += "\r\n";
+  if (body) {
+    wire.append(body, body_size);
+  }
+  return nullptr;
+}
+
+/* io.http.request(options [, func]), without func it yields the running coroutine */
+static int luaf_request(lua_State* L) {
+  auto call = std::make_shared<http_call>();
+  const char* err = check_request(L, 1, call);
+  bool yield = lua_isnoneornil(L, 2);
+  if (yield && !lua_isyieldable(L)) {
+    luaL_error(L, "io.http.request needs a callback outside a coroutine");
+  }
+  if (err) {
+    if (yield) {
+      lua_pushnil(L);
+      lua_pushstring(L, err);
+      return 2;
+    }
+    lua_pushboolean(L, 0);
+    lua_pushstring(L, err);
+    return 2;
+  }
+  if (lua_getfield(L, 1, "on_body") == LUA_TFUNCTION) {
+    call->rbody = luaC_ref(L, -1);
+  }
+  lua_pop(L, 1);
+  if (yield) {
+    lua_State* main = luaC_getlocal();
+    lua_pushthread(L);
+    lua_xmove(L, main, 1);
+    call->rcb = luaC_ref(main, -1);
+    lua_pop(main, 1);
+  }
+  else {
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+    call->rcb = luaC_ref(L, 2);
+  }
+  /* never answered before the caller has yielded */
+  pool().hosts[call->key].waiting.push_back(call);
+  arm_ticker();
+  auto key = call->key;
+  lws::post([key]() { dispatch(key); });
+  if (yield) {
+    return lua_yield(L, 0);
+  }
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+/* io.http.pool{ connections = 8, pipeline = 1, keepalive = 30000 } for this job */
+static int luaf_pool(lua_State* L) {
+  luaL_checktype(L, 1, LUA_TTABLE);
+  auto& self = pool();
+  lua_getfield(L, 1, "connections");
+  lua_Integer conns = luaL_optinteger(L, -1, (lua_Integer)self.max_conns);
+  lua_getfield(L, 1, "pipeline");
+  lua_Integer depth = luaL_optinteger(L, -1, (lua_Integer)self.pipeline);
+  lua_getfield(L, 1, "keepalive");
+  lua_Integer keepalive = luaL_optinteger(L, -1, (lua_Integer)self.keepalive);
+  lua_pop(L, 3);
+  luaL_argcheck(L, conns > 0, 1, "connections must be > 0");
+  luaL_argcheck(L, depth > 0, 1, "pipeline must be > 0");
+  luaL_argcheck(L, keepalive >= 0, 1, "keepalive must be >= 0");
+  self.max_conns = (size_t)conns;
+  self.pipeline  = (size_t)depth;
+  self.keepalive = (size_t)keepalive;
+  return 0;
+}
+
+/********************************************************************************/
+
+LUAC_API int luaC_open_httpc(lua_State* L) {
+  const luaL_Reg methods[] = {
+    { "request",    luaf_request    },
+    { "pool",       luaf_pool       },
+    { NULL,         NULL            }
+  };
+  lua_getglobal(L, "io");
+  lua_getfield(L, -1, "http");
+  luaL_setfuncs(L, methods, 0);
+  lua_pop(L, 2); /* pop 'io.http' and 'io' from stack */
+  return 0;
+}
+
+/********************************************************************************/
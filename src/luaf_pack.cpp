@@ -5,6 +5,9 @@
 
 #include <math.h>
 #include <set>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
@@ -21,6 +24,15 @@
 #define IS_INT64_EQUIVALENT(x) IS_INT_TYPE_EQUIVALENT(x, int64_t)
 #define IS_INT_EQUIVALENT(x) IS_INT_TYPE_EQUIVALENT(x, int)
 
+/* Shared-string dictionary: strings in [MINLEN, MAXLEN] are candidates. */
+#define LUACMSGPACK_DICT_META     "msgpack:dict"
+#define LUACMSGPACK_DICT_MINLEN   4       /* shorter ones gain nothing */
+#define LUACMSGPACK_DICT_MAXLEN   64      /* keys and enums, not payloads */
+#define LUACMSGPACK_DICT_DEFAULT  4096
+#define LUACMSGPACK_DICT_LIMIT    65536   /* references are at most 16 bits */
+#define LUACMSGPACK_EXT_DEFINE    0x7e    /* ext8: new string, append it */
+#define LUACMSGPACK_EXT_REFER     0x7f    /* fixext1/2: index of a string */
+
 /* If size of pointer is equal to a 4 byte integer, we're on 32 bits. */
 #if UINTPTR_MAX == UINT_MAX
 #define BITS_32 1
@@ -87,9 +99,27 @@ static void memrevifle(void *ptr, size_t len) {
 * The string buffer uses 2x preallocation on every realloc for O(N) append
 * behavior.  */
 
+/* ---------------------------- Dictionary -------------------------------------
+* A dictionary lives on one connection and has two independent halves: the
+* strings we have sent (looked up by value) and the strings we have received
+* (looked up by index). Each half only grows, in the same order on both ends,
+* so the peers stay in sync without exchanging the tables themselves. A string
+* is only defined when it shows up a second time, so one-off values don't use
+* up the table; the sightings are local to the sender and simply forgotten
+* when there are too many of them. */
+
+typedef struct mp_dict {
+  size_t capacity;
+  std::unordered_map<std::string, uint32_t> sent;
+  std::vector<std::string> sent_order;
+  std::vector<std::string> received;
+  std::unordered_set<std::string> seen;
+} mp_dict;
+
 typedef struct mp_buf {
   unsigned char *b;
   size_t len, free;
+  mp_dict *dict;
 } mp_buf;
 
 static void *mp_realloc(lua_State *L, void *target, size_t osize,size_t nsize) {
@@ -109,6 +139,7 @@ static mp_buf *mp_buf_new(lua_State *L) {
 
   buf->b = NULL;
   buf->len = buf->free = 0;
+  buf->dict = NULL;
   return buf;
 }
 
@@ -146,12 +177,14 @@ typedef struct mp_cur {
   const unsigned char *p;
   size_t left;
   int err;
+  mp_dict *dict;
 } mp_cur;
 
 static void mp_cur_init(mp_cur *cursor, const unsigned char *s, size_t len) {
   cursor->p = s;
   cursor->left = len;
   cursor->err = MP_CUR_ERROR_NONE;
+  cursor->dict = NULL;
 }
 
 #define mp_cur_consume(_c,_len) do { _c->p += _len; _c->left -= _len; } while(0)
@@ -196,6 +229,52 @@ static void mp_encode_bytes(lua_State *L, mp_buf *buf, const unsigned char *s, s
   mp_buf_append(L,buf,s,len);
 }
 
+/* Encode a string through the dictionary: a known string becomes a 3 or 4
+* bytes reference, a repeated one is sent once as a definition and a new one
+* goes out as is. */
+static void mp_encode_dict_bytes(lua_State *L, mp_buf *buf, const unsigned char *s, size_t len) {
+  unsigned char hdr[4];
+  mp_dict *dict = buf->dict;
+  std::string key((const char*)s, len);
+  auto iter = dict->sent.find(key);
+
+  if (iter != dict->sent.end()) {
+    uint32_t index = iter->second;
+    if (index <= 0xff) {
+      hdr[0] = 0xd4;    /* fixext 1 */
+      hdr[1] = LUACMSGPACK_EXT_REFER;
+      hdr[2] = (unsigned char)index;
+      mp_buf_append(L,buf,hdr,3);
+    } else {
+      hdr[0] = 0xd5;    /* fixext 2 */
+      hdr[1] = LUACMSGPACK_EXT_REFER;
+      hdr[2] = (unsigned char)((index&0xff00)>>8);
+      hdr[3] = (unsigned char)((index&0xff));
+      mp_buf_append(L,buf,hdr,4);
+    }
+    return;
+  }
+  if (dict->sent_order.size() >= dict->capacity) {
+    mp_encode_bytes(L,buf,s,len);
+    return;
+  }
+  if (dict->seen.erase(key) == 0) {
+    if (dict->seen.size() >= dict->capacity * 4) {
+      dict->seen.clear();
+    }
+    dict->seen.insert(std::move(key));
+    mp_encode_bytes(L,buf,s,len);
+    return;
+  }
+  hdr[0] = 0xc7;        /* ext 8 */
+  hdr[1] = (unsigned char)len;
+  hdr[2] = LUACMSGPACK_EXT_DEFINE;
+  mp_buf_append(L,buf,hdr,3);
+  mp_buf_append(L,buf,s,len);
+  dict->sent.insert(std::make_pair(key, (uint32_t)dict->sent_order.size()));
+  dict->sent_order.push_back(key);
+}
+
 /* we assume IEEE 754 internal format for single and double precision floats. */
 static void mp_encode_double(lua_State *L, mp_buf *buf, double d) {
   unsigned char b[9];
@@ -340,7 +419,10 @@ static void mp_encode_lua_string(lua_State *L, mp_buf *buf) {
   const char *s;
 
   s = lua_tolstring(L,-1,&len);
-  mp_encode_bytes(L,buf,(const unsigned char*)s,len);
+  if (buf->dict && len >= LUACMSGPACK_DICT_MINLEN && len <= LUACMSGPACK_DICT_MAXLEN)
+    mp_encode_dict_bytes(L,buf,(const unsigned char*)s,len);
+  else
+    mp_encode_bytes(L,buf,(const unsigned char*)s,len);
 }
 
 static void mp_encode_lua_bool(lua_State *L, mp_buf *buf) {
@@ -521,11 +603,11 @@ static void mp_encode_lua_type(lua_State *L, mp_buf *buf, int level) {
 }
 
 /*
-* Packs all arguments as a stream for multiple upacking later.
+* Packs all arguments from 'first' as a stream for multiple upacking later.
 * Returns error if no arguments provided.
 */
-static int pack_any(lua_State *L) {
-  int nargs = lua_gettop(L);
+static int mp_pack_full(lua_State *L, int first, mp_dict *dict) {
+  int nargs = lua_gettop(L) - first + 1;
   int i;
   mp_buf *buf;
 
@@ -536,7 +618,8 @@ static int pack_any(lua_State *L) {
     return luaL_argerror(L, 0, "Too many arguments for pack.");
 
   buf = mp_buf_new(L);
-  for(i = 1; i <= nargs; i++) {
+  buf->dict = dict;
+  for(i = first; i < first + nargs; i++) {
     /* Copy argument i to top of stack for _encode processing;
     * the encode function pops it from the stack when complete. */
     luaL_checkstack(L, 1, "in function mp_check");
@@ -557,6 +640,10 @@ static int pack_any(lua_State *L) {
   return 1;
 }
 
+static int pack_any(lua_State *L) {
+  return mp_pack_full(L, 1, NULL);
+}
+
 /* ------------------------------- Decoding --------------------------------- */
 
 static void mp_decode_to_lua_type(lua_State *L, mp_cur *c);
@@ -739,6 +826,37 @@ static void mp_decode_to_lua_type(lua_State *L, mp_cur *c) {
       mp_cur_consume(c,l);
     }
     break;
+  case 0xc7:  /* ext 8, dictionary definition */
+    mp_cur_need(c,3);
+    {
+      size_t l = c->p[1];
+      mp_cur_need(c,3+l);
+      if (!c->dict || c->p[2] != LUACMSGPACK_EXT_DEFINE ||
+        c->dict->received.size() >= LUACMSGPACK_DICT_LIMIT) {
+        c->err = MP_CUR_ERROR_BADFMT;
+        return;
+      }
+      c->dict->received.push_back(std::string((char*)c->p+3,l));
+      lua_pushlstring(L,(char*)c->p+3,l);
+      mp_cur_consume(c,3+l);
+    }
+    break;
+  case 0xd4:  /* fixext 1, dictionary reference */
+  case 0xd5:  /* fixext 2, dictionary reference */
+    {
+      size_t n = (c->p[0] == 0xd4) ? 3 : 4;
+      mp_cur_need(c,n);
+      size_t index = (n == 3) ? c->p[2] : ((c->p[2] << 8) | c->p[3]);
+      if (!c->dict || c->p[1] != LUACMSGPACK_EXT_REFER ||
+        index >= c->dict->received.size()) {
+        c->err = MP_CUR_ERROR_BADFMT;
+        return;
+      }
+      const std::string& str = c->dict->received[index];
+      lua_pushlstring(L,str.c_str(),str.size());
+      mp_cur_consume(c,n);
+    }
+    break;
   case 0xdc:  /* array 16 */
     mp_cur_need(c,3);
     {
@@ -815,10 +933,10 @@ static int mp_unpack_full(lua_State *L, int limit, int offset) {
   if (offset < 0 || limit < 0) /* requesting negative off or lim is invalid */
     return luaL_error(L,
       "Invalid request to unpack with offset of %d and limit of %d.",
-      offset, len);
-  else if (offset > len)
+      offset, limit);
+  else if ((size_t)offset > len)
     return luaL_error(L,
-      "Start offset %d greater than input length %d.", offset, len);
+      "Start offset %d greater than input length %d.", offset, (int)len);
 
   if (decode_all) limit = INT_MAX;
 
@@ -906,12 +1024,103 @@ static int mp_safe(lua_State *L) {
   return 2;
 }
 
+/* ------------------------------ Dictionary -------------------------------- */
+
+static mp_dict *mp_checkdict(lua_State *L, int index) {
+  return luaC_checkudata<mp_dict>(L, index, LUACMSGPACK_DICT_META);
+}
+
+static int dict_pack(lua_State *L) {
+  mp_dict *dict = mp_checkdict(L, 1);
+  return mp_pack_full(L, 2, dict);
+}
+
+/* Same contract as wrap, but if encoding fails the strings defined by the
+* failed message are withdrawn, since the peer will never see them. */
+static int dict_wrap(lua_State *L) {
+  mp_dict *dict = mp_checkdict(L, 1);
+  size_t mark = dict->sent_order.size();
+
+  lua_pushcfunction(L, dict_pack);
+  lua_insert(L, 1);
+  if (lua_pcall(L, lua_gettop(L) - 1, 1, 0) == LUA_OK) {
+    return 1;
+  }
+  while (dict->sent_order.size() > mark) {
+    dict->sent.erase(dict->sent_order.back());
+    dict->sent_order.pop_back();
+  }
+  lua_pushnil(L);
+  lua_insert(L,-2);
+  return 2;
+}
+
+static int dict_unwrap(lua_State *L) {
+  size_t len;
+  mp_cur c;
+  int cnt;
+  mp_dict *dict = mp_checkdict(L, 1);
+  const char *s = luaL_checklstring(L, 2, &len);
+
+  mp_cur_init(&c,(const unsigned char *)s,len);
+  c.dict = dict;
+  for(cnt = 0; c.left > 0; cnt++) {
+    mp_decode_to_lua_type(L,&c);
+
+    if (c.err == MP_CUR_ERROR_EOF) {
+      return luaL_error(L,"Missing bytes in input.");
+    } else if (c.err == MP_CUR_ERROR_BADFMT) {
+      return luaL_error(L,"Bad data format in input.");
+    }
+  }
+  return cnt;
+}
+
+static int dict_size(lua_State *L) {
+  mp_dict *dict = mp_checkdict(L, 1);
+  lua_pushinteger(L, (lua_Integer)dict->sent_order.size());
+  lua_pushinteger(L, (lua_Integer)dict->received.size());
+  return 2;
+}
+
+static int dict_gc(lua_State *L) {
+  mp_dict *dict = mp_checkdict(L, 1);
+  dict->~mp_dict();
+  return 0;
+}
+
+static int dict_create(lua_State *L) {
+  lua_Integer capacity = luaL_optinteger(L, 1, LUACMSGPACK_DICT_DEFAULT);
+  luaL_argcheck(L, capacity > 0 && capacity <= LUACMSGPACK_DICT_LIMIT, 1, "out of range");
+
+  mp_dict *dict = luaC_newuserdata<mp_dict>(L, LUACMSGPACK_DICT_META);
+  dict->capacity = (size_t)capacity;
+  return 1;
+}
+
+static void dict_metatable(lua_State *L) {
+  const luaL_Reg methods[] = {
+    { "__gc",           dict_gc        },
+    { "wrap",           dict_wrap      },
+    { "unwrap",         dict_unwrap    },
+    { "size",           dict_size      },
+    { NULL,             NULL           }
+  };
+  luaC_newmetatable(L, LUACMSGPACK_DICT_META, methods);
+  /* unwrap reports errors the same way as the global one */
+  lua_getfield(L, -1, "unwrap");
+  lua_pushcclosure(L, mp_safe, 1);
+  lua_setfield(L, -2, "unwrap");
+  lua_pop(L, 1);
+}
+
 static const struct luaL_Reg methods[] = {
   { "wrap",           pack_any       },
   { "unwrap",         unpack_any     },
   { "unwrap_rest",    unpack_rest    },
   { "unwrap_one",     unpack_one     },
   { "unwrap_limit",   unpack_limit   },
+  { "wrap_dict",      dict_create    },
   { NULL,             NULL           }
 };
 
@@ -972,6 +1181,7 @@ LUAC_API int luaC_unpack(lua_State* L) {
 /********************************************************************************/
 
 LUAC_API int luaC_open_pack(lua_State* L) {
+  dict_metatable(L);
   package_create(L);
   /* Wrap all functions in the safe handler */
   for (int i = 0; i < (sizeof(methods)/sizeof(*methods) - 1); i++) {
@@ -2,6 +2,7 @@
 
 #include <string.h>
 #include <eport/detail/os/os.hpp>
+#include <eport/detail/io/conv.hpp>
 #include "luaf_require.h"
 
 /********************************************************************************/
@@ -56,42 +57,6 @@ static const char* normal(const char* filename, char* out) {
   return out;
 }
 
-static bool check_utf8(const char* p, size_t n = 0) {
-  unsigned char chr;
-  size_t i = 0, follow = 0;
-  for (; n ? (i < n) : (p[i] != 0); i++) {
-    chr = p[i];
-    if (follow == 0) {
-      if (chr > 0x80) {
-        if (chr == 0xfc || chr == 0xfd) {
-          follow = 5;
-        }
-        else if (chr >= 0xf8) {
-          follow = 4;
-        }
-        else if (chr >= 0xf0) {
-          follow = 3;
-        }
-        else if (chr >= 0xe0) {
-          follow = 2;
-        }
-        else if (chr >= 0xc0) {
-          follow = 1;
-        }
-        else {
-          return false;
-        }
-      }
-    } else {
-      follow--;
-      if ((chr & 0xC0) != 0x80) {
-        return false;
-      }
-    }
-  }
-  return (follow == 0);
-}
-
 static const char* skipBOM(const char* buff, size_t* size) {
   const char *p = "\xEF\xBB\xBF";  /* UTF-8 BOM mark */
   for (; (*size) > 0 && *p != '\0'; buff++, (*size)--)
@@ -107,7 +72,7 @@ static const char* skip_common(lua_State* L, const char* buff, size_t& size) {
         size--;
       } while (*(++buff) != '\n');
     }
-    if (!check_utf8(buff, size)) {
+    if (!eport::is_utf8(buff, size)) {
       return NULL;
     }
   }
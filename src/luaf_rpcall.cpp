@@ -39,7 +39,8 @@ typedef std::map<
 > invoke_map_type;
 
 #define max_expires  10000
-#define is_local(what) (what <= 0xffff)
+/* local jobs are 32-bit lws handles, remote callers are (caller << 32 | session) */
+#define is_local(what) (what <= 0x7fffffff)
 #define unique_mutex_lock(what) std::unique_lock<std::mutex> lock(what)
 
 static std::mutex      rpcall_lock;
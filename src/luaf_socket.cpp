@@ -1,39 +1,76 @@
 
 
+#include <errno.h>
 #include <string.h>
+#include <system_error>
+#include <unordered_set>
+#include <vector>
 #include "luaf_socket.h"
 #include "socket.io/socket.io.hpp"
 
 #define LUAC_SOCKET "io:socket"
+#define LUAC_GROUP  "io:group"
 
 /********************************************************************************/
 
 struct ud_context {
   bool accept;
   lws_int handle;
+  int rdrain; /* drain callback refer */
 };
 
-static lws_cainfo* init_cainfo(lua_State* L, lws_cainfo* pinfo) {
+/* the options table follows the family and any certificate arguments */
+static int find_options(lua_State* L) {
+  int top = lua_gettop(L);
+  for (int i = 2; i <= top && i <= 5; i++) {
+    if (lua_istable(L, i)) {
+      return i;
+    }
+  }
+  return 0;
+}
+
+/* certificate from an options field, the table keeps the string alive */
+static const char* opt_cafield(lua_State* L, int opts, const char* name, size_t* size) {
+  int type = lua_getfield(L, opts, name);
+  luaL_argcheck(L, type == LUA_TNIL || type == LUA_TSTRING, opts, "certificates must be strings");
+  const char* data = lua_tolstring(L, -1, size);
+  lua_pop(L, 1);
+  return data;
+}
+
+/* io.socket(family, ca) verifies the peer, io.socket(family, crt, key, pwd) serves,
+   either can also come as ca or crt, key, pwd fields of the options */
+static lws_cainfo* init_cainfo(lua_State* L, lws_cainfo* pinfo, int opts) {
   memset(pinfo, 0, sizeof(lws_cainfo));
-  if (lua_isnoneornil(L, 3)) {
-    return nullptr;
+  int last = opts ? opts - 1 : lua_gettop(L);
+  if (last < 2 || lua_isnil(L, 2)) {
+    if (opts == 0) {
+      return nullptr;
+    }
+    pinfo->crt.data = opt_cafield(L, opts, "crt", &pinfo->crt.size);
+    if (pinfo->crt.data) {
+      pinfo->key.data = opt_cafield(L, opts, "key", &pinfo->key.size);
+      luaL_argcheck(L, pinfo->key.data != nullptr, opts, "crt needs a key");
+      pinfo->pwd = opt_cafield(L, opts, "pwd", nullptr);
+      return pinfo;
+    }
+    pinfo->caf = opt_cafield(L, opts, "ca", &pinfo->caf_size);
+    return pinfo->caf ? pinfo : nullptr;
   }
-  pinfo->caf = luaL_checklstring(L, 3, &pinfo->caf_size);
-  if (lua_isnoneornil(L, 4)) {
+  if (last < 3 || lua_isnil(L, 3)) {
+    pinfo->caf = luaL_checklstring(L, 2, &pinfo->caf_size);
     return pinfo;
   }
-  pinfo->crt.data = luaL_checklstring(L, 3, &pinfo->crt.size);
-  if (lua_isnoneornil(L, 4)) {
-    return pinfo;
-  }
-  pinfo->key.data = luaL_checklstring(L, 4, &pinfo->key.size);
-  pinfo->pwd = luaL_optstring(L, 5, nullptr);
+  pinfo->crt.data = luaL_checklstring(L, 2, &pinfo->crt.size);
+  pinfo->key.data = luaL_checklstring(L, 3, &pinfo->key.size);
+  pinfo->pwd = last < 4 ? nullptr : luaL_optstring(L, 4, nullptr);
   return pinfo;
 }
 
-static lws_int new_socket(lua_State* L) {
+static lws_int new_socket(lua_State* L, int opts) {
   lws_cainfo info;
-  lws_cainfo* ca = init_cainfo(L, &info);
+  lws_cainfo* ca = init_cainfo(L, &info, opts);
   const char* family = luaL_optstring(L, 1, "tcp");
 
   if (strcmp(family, "tcp") == 0) {
@@ -48,30 +85,219 @@ static lws_int new_socket(lua_State* L) {
   if (strcmp(family, "wss") == 0) {
     return lws::socket(lws_family::wss, ca);
   }
+  if (strcmp(family, "kcp") == 0) {
+    lws_int handle = lws::socket(lws_family::kcp, nullptr);
+    if (handle <= 0) {
+      luaL_error(L, "kcp is not supported by this build");
+    }
+    return handle;
+  }
   luaL_error(L, "invalid socket family: ", family);
   return 0;
 }
 
+/* options: framing = "u16be" | "u32le" | "line" | "msgpack", max_size */
+static lws_framing check_framing(lua_State* L, int index, lws_size* max_size) {
+  static const char* const names[] = {
+    "none", "u16be", "u32le", "line", "msgpack", nullptr
+  };
+  lua_getfield(L, index, "framing");
+  int type = luaL_checkoption(L, -1, "none", names);
+  lua_getfield(L, index, "max_size");
+  lua_Integer size = luaL_optinteger(L, -1, 8 * 1024 * 1024);
+  lua_pop(L, 2);
+  luaL_argcheck(L, size >= 0, index, "max_size must be >= 0");
+  *max_size = (lws_size)size;
+  return (lws_framing)type;
+}
+
+/* options: deflate = false | { window_bits, mem_level, min_size, takeover } */
+static bool check_deflate(lua_State* L, int index, lws_deflate* opt) {
+  opt->enable      = lws_true;
+  opt->takeover    = lws_false;
+  opt->window_bits = 15;
+  opt->mem_level   = 8;
+  opt->min_size    = 16;
+  int type = lua_getfield(L, index, "deflate");
+  if (type == LUA_TNIL) {
+    lua_pop(L, 1);
+    return false;
+  }
+  if (type == LUA_TBOOLEAN) {
+    opt->enable = lua_toboolean(L, -1) ? lws_true : lws_false;
+    lua_pop(L, 1);
+    return true;
+  }
+  luaL_argcheck(L, type == LUA_TTABLE, index, "deflate must be a boolean or a table");
+  lua_getfield(L, -1, "window_bits");
+  lua_getfield(L, -2, "mem_level");
+  lua_getfield(L, -3, "min_size");
+  lua_getfield(L, -4, "takeover");
+  lua_Integer window_bits = luaL_optinteger(L, -4, opt->window_bits);
+  lua_Integer mem_level   = luaL_optinteger(L, -3, opt->mem_level);
+  lua_Integer min_size    = luaL_optinteger(L, -2, (lua_Integer)opt->min_size);
+  if (!lua_isnil(L, -1)) {
+    opt->takeover = lua_toboolean(L, -1) ? lws_true : lws_false;
+  }
+  lua_pop(L, 5);
+  luaL_argcheck(L, window_bits >= 9 && window_bits <= 15, index, "window_bits must be 9..15");
+  luaL_argcheck(L, mem_level >= 1 && mem_level <= 9, index, "mem_level must be 1..9");
+  luaL_argcheck(L, min_size >= 0, index, "min_size must be >= 0");
+  opt->window_bits = (lws_int)window_bits;
+  opt->mem_level   = (lws_int)mem_level;
+  opt->min_size    = (lws_size)min_size;
+  return true;
+}
+
+/* options: sndwnd, rcvwnd, mtu, interval, nodelay = true, resend, nc = true */
+static bool check_kcp(lua_State* L, int index, lws_kcp* opt) {
+  static const char* const names[] = {
+    "sndwnd", "rcvwnd", "mtu", "interval", "nodelay", "resend", "nc", nullptr
+  };
+  bool found = false;
+  for (int i = 0; names[i]; i++) {
+    lua_getfield(L, index, names[i]);
+    found = found || !lua_isnil(L, -1);
+    lua_pop(L, 1);
+  }
+  if (!found) {
+    return false;
+  }
+  lua_getfield(L, index, "sndwnd");
+  lua_getfield(L, index, "rcvwnd");
+  lua_getfield(L, index, "mtu");
+  lua_getfield(L, index, "interval");
+  lua_getfield(L, index, "resend");
+  opt->snd_wnd  = (lws_int)luaL_optinteger(L, -5, 64);
+  opt->rcv_wnd  = (lws_int)luaL_optinteger(L, -4, 256);
+  opt->mtu      = (lws_int)luaL_optinteger(L, -3, 1400);
+  opt->interval = (lws_int)luaL_optinteger(L, -2, 10);
+  opt->resend   = (lws_int)luaL_optinteger(L, -1, 2);
+  lua_pop(L, 5);
+  lua_getfield(L, index, "nodelay");
+  lua_getfield(L, index, "nc");
+  opt->nodelay  = (lua_isnil(L, -2) || lua_toboolean(L, -2)) ? 1 : 0;
+  opt->nc       = (lua_isnil(L, -1) || lua_toboolean(L, -1)) ? 1 : 0;
+  lua_pop(L, 2);
+  luaL_argcheck(L, opt->snd_wnd > 0 && opt->rcv_wnd > 0, index, "windows must be > 0");
+  luaL_argcheck(L, opt->mtu >= 50 && opt->mtu <= 65000, index, "mtu must be 50..65000");
+  luaL_argcheck(L, opt->interval >= 1 && opt->interval <= 5000, index, "interval must be 1..5000");
+  luaL_argcheck(L, opt->resend >= 0, index, "resend must be >= 0");
+  return true;
+}
+
 static int luaf_socket(lua_State* L) {
+  lws_size max_size = 0;
+  lws_framing framing = lws_framing::none;
+  lws_deflate deflate;
+  lws_kcp kcp;
+  bool has_deflate = false, has_kcp = false;
+  int opts = find_options(L);
+  if (opts) {
+    framing = check_framing(L, opts, &max_size);
+    has_deflate = check_deflate(L, opts, &deflate);
+    has_kcp = check_kcp(L, opts, &kcp);
+  }
+  lws_int handle = new_socket(L, opts);
+  if (framing != lws_framing::none && handle > 0) {
+    if (lws::setframing(handle, framing, max_size) != lws_true) {
+      lws::close(handle);
+      luaL_error(L, "framing is only for tcp/ssl sockets");
+    }
+  }
+  if (has_deflate && handle > 0) {
+    if (lws::setdeflate(handle, &deflate) != lws_true) {
+      lws::close(handle);
+      luaL_error(L, "deflate is only for ws/wss sockets");
+    }
+  }
+  if (has_kcp && handle > 0) {
+    if (lws::setkcp(handle, &kcp) != lws_true) {
+      lws::close(handle);
+      luaL_error(L, "these options are only for kcp sockets");
+    }
+  }
+  auto ud = luaC_newuserdata<ud_context>(L, LUAC_SOCKET);
+  ud->accept = false;
+  ud->handle = handle;
+  ud->rdrain = 0;
+  return 1;
+}
+
+static void push_peer(lua_State* L, lws_int handle) {
   auto ud = luaC_newuserdata<ud_context>(L, LUAC_SOCKET);
   ud->accept = false;
-  ud->handle = new_socket(L);
+  ud->handle = handle;
+  ud->rdrain = 0;
+}
+
+/* a socket that was detached by another job continues here */
+static int luaf_adopt(lua_State* L) {
+  lws_int token = (lws_int)luaL_checkinteger(L, 1);
+  lws_int handle = lws::adopt(token);
+  if (handle <= 0) {
+    lua_pushnil(L);
+    lua_pushstring(L, handle == lws_error ? "invalid token" : std::system_category().message(-handle).c_str());
+    return 2;
+  }
+  push_peer(L, handle);
   return 1;
 }
 
+/* io.acceptor([<tcp/kcp>]), a kcp acceptor takes kcp sockets */
 static int luaf_acceptor(lua_State* L) {
+  const char* family = luaL_optstring(L, 1, "tcp");
+  lws_int handle = 0;
+  if (strcmp(family, "kcp") == 0) {
+    handle = lws::kcpacceptor();
+    if (handle <= 0) {
+      luaL_error(L, "kcp is not supported by this build");
+    }
+  }
+  else if (strcmp(family, "tcp") == 0) {
+    handle = lws::acceptor();
+  }
+  else {
+    luaL_error(L, "invalid acceptor family: %s", family);
+  }
   auto ud = luaC_newuserdata<ud_context>(L, LUAC_SOCKET);
   ud->accept = true;
-  ud->handle = lws::acceptor();
+  ud->handle = handle;
+  ud->rdrain = 0;
   return 1;
 }
 
 static int luaf_close(lua_State* L) {
   auto ud = luaC_checkudata<ud_context>(L, 1, LUAC_SOCKET);
+  if (ud->rdrain) {
+    lws::ondrain(ud->handle, nullptr, nullptr);
+    luaC_unref(L, ud->rdrain);
+    ud->rdrain = 0;
+  }
   lws::close(ud->handle);
   return 0;
 }
 
+/* the pending receive ends with an error, the token goes to io.adopt() of any job */
+static int luaf_detach(lua_State* L) {
+  auto ud = luaC_checkudata<ud_context>(L, 1, LUAC_SOCKET);
+  if (ud->accept) {
+    luaL_error(L, "invalid method");
+  }
+  lws_int token = lws::detach(ud->handle);
+  if (token <= 0) {
+    lua_pushnil(L);
+    lua_pushstring(L, token == lws_error ? "invalid socket" : std::system_category().message(-token).c_str());
+    return 2;
+  }
+  if (ud->rdrain) {
+    luaC_unref(L, ud->rdrain);
+    ud->rdrain = 0;
+  }
+  lua_pushinteger(L, token);
+  return 1;
+}
+
 static int luaf_valid(lua_State* L) {
   auto ud = luaC_checkudata<ud_context>(L, 1, LUAC_SOCKET);
   lua_pushboolean(L, lws::valid(ud->handle));
@@ -100,8 +326,22 @@ static int luaf_listen(lua_State* L) {
     luaL_error(L, "invalid method");
   }
   lws_ushort  port = (lws_ushort)luaL_checkinteger(L, 2);
-  const char* host = luaL_optstring(L, 3, nullptr);
-  int backlog = (int)luaL_optinteger(L, 4, 32);
+  const char* host = nullptr;
+  int backlog = 32, options = 0;
+  if (lua_istable(L, 3)) {
+    options = 3;
+  }
+  else {
+    host    = luaL_optstring(L, 3, nullptr);
+    backlog = (int)luaL_optinteger(L, 4, 32);
+    options = lua_istable(L, 5) ? 5 : 0;
+  }
+  /* options: reuseport = true lets several jobs listen on the same port */
+  if (options) {
+    lua_getfield(L, options, "reuseport");
+    lws::reuseport(ud->handle, lua_toboolean(L, -1) != 0);
+    lua_pop(L, 1);
+  }
   lws_int  ok = lws::listen(ud->handle, port, host, backlog);
   lua_pushboolean(L, ok == lws_true ? 1 : 0);
   return 1;
@@ -140,6 +380,57 @@ static void on_accept(int ec, int, int acceptor, int rpeer, int rcb) {
   }
 }
 
+/* func(ec, list) or func(ec, peer) for each peer with each = true,
+   a peer that failed its handshake comes alone with ec set */
+static lws_int accept_batch(lws_int acceptor, lws_int proto, int rcb, lws_size max_batch, bool each) {
+  return lws::acceptbatch(acceptor, proto, max_batch, [rcb, each](int ec, const lws_int* peers, lws_size count) {
+    lua_State* L = luaC_getlocal();
+    revert_if_return revert(L);
+    unref_if_return  unref_rcb(L, rcb);
+    if (!ec || count > 0) {
+      unref_rcb.cancel();
+    }
+    if (ec || !each) {
+      luaC_rawgeti(L, rcb);
+      if (lua_type(L, -1) != LUA_TFUNCTION) {
+        return;
+      }
+      lua_pushinteger(L, ec);
+      if (count == 0) {
+        lua_pushnil(L);
+      }
+      else if (each) {
+        push_peer(L, peers[0]);
+      }
+      else {
+        lua_createtable(L, (int)count, 0);
+        for (lws_size i = 0; i < count; i++) {
+          push_peer(L, peers[i]);
+          lua_rawseti(L, -2, (lua_Integer)i + 1);
+        }
+      }
+      if (luaC_xpcall(L, 2, 0) != LUA_OK) {
+        lua_ferror("%s\n", lua_tostring(L, -1));
+      }
+      return;
+    }
+    for (lws_size i = 0; i < count; i++) {
+      luaC_rawgeti(L, rcb);
+      if (lua_type(L, -1) != LUA_TFUNCTION) {
+        lua_pop(L, 1);
+        lws::close(peers[i]);
+        continue;
+      }
+      lua_pushinteger(L, 0);
+      push_peer(L, peers[i]);
+      if (luaC_xpcall(L, 2, 0) != LUA_OK) {
+        lua_ferror("%s\n", lua_tostring(L, -1));
+        lua_pop(L, 1);
+      }
+    }
+  });
+}
+
 static int luaf_accept(lua_State* L) {
   auto ud   = luaC_checkudata<ud_context>(L, 1, LUAC_SOCKET);
   auto peer = luaC_checkudata<ud_context>(L, 2, LUAC_SOCKET);
@@ -147,6 +438,18 @@ static int luaf_accept(lua_State* L) {
     luaL_error(L, "invalid method");
   }
   auto acceptor = ud->handle;
+  if (!lua_isnoneornil(L, 4)) {
+    luaL_checktype(L, 3, LUA_TFUNCTION);
+    lua_Integer batch = luaL_checkinteger(L, 4);
+    luaL_argcheck(L, batch > 0, 4, "must be > 0");
+    int rcb = luaC_ref(L, 3);
+    lws_int ok = accept_batch(acceptor, peer->handle, rcb, (lws_size)batch, lua_toboolean(L, 5) != 0);
+    if (ok != lws_true) {
+      luaC_unref(L, rcb);
+    }
+    lua_pushboolean(L, ok == lws_true ? 1 : 0);
+    return 1;
+  }
   if (lua_isnoneornil(L, 3)) {
     lws_int ok = lws::accept(acceptor, peer->handle);
     lua_pushboolean(L, ok == lws_true ? 1 : 0);
@@ -205,19 +508,84 @@ static int luaf_send(lua_State* L) {
     luaL_error(L, "invalid method");
   }
   const char* data = luaL_checklstring(L, 2, &size);
-  lws_int ok = lws::send(ud->handle, data, size);
+  /* the string is pinned in the registry until it has been written */
+  int rdata = luaC_ref(L, 2);
+  lws_int ok = lws::sendref(ud->handle, data, size, [rdata](int, lws_size) {
+    luaC_unref(luaC_getlocal(), rdata);
+  });
+  if (ok != lws_true) {
+    luaC_unref(L, rdata);
+  }
   lua_pushboolean(L, ok == lws_true ? 1 : 0);
   return 1;
 }
 
-static int luaf_receive(lua_State* L) {
+static int luaf_pending(lua_State* L) {
+  auto ud = luaC_checkudata<ud_context>(L, 1, LUAC_SOCKET);
+  if (ud->accept) {
+    luaL_error(L, "invalid method");
+  }
+  lws_size bytes = 0;
+  lws_int ok = lws::pending(ud->handle, &bytes);
+  lua_pushinteger(L, ok == lws_true ? (lua_Integer)bytes : 0);
+  return 1;
+}
+
+static int luaf_watermark(lua_State* L) {
   auto ud = luaC_checkudata<ud_context>(L, 1, LUAC_SOCKET);
   if (ud->accept) {
     luaL_error(L, "invalid method");
   }
+  lua_Integer high = luaL_checkinteger(L, 2);
+  lua_Integer low  = luaL_optinteger(L, 3, high / 2);
+  luaL_argcheck(L, high >= 0, 2, "must be >= 0");
+  luaL_argcheck(L, low  >= 0, 3, "must be >= 0");
+  lws_int ok = lws::watermark(ud->handle, (lws_size)high, (lws_size)low);
+  lua_pushboolean(L, ok == lws_true ? 1 : 0);
+  return 1;
+}
+
+static void on_drain(lws_context ud) {
+  lua_State* L = luaC_getlocal();
+  revert_if_return revert(L);
+  luaC_rawgeti(L, (int)(intptr_t)ud);
+  if (lua_type(L, -1) != LUA_TFUNCTION) {
+    return;
+  }
+  if (luaC_xpcall(L, 0, 0) != LUA_OK) {
+    lua_ferror("%s\n", lua_tostring(L, -1));
+  }
+}
+
+static int luaf_ondrain(lua_State* L) {
+  auto ud = luaC_checkudata<ud_context>(L, 1, LUAC_SOCKET);
+  if (ud->accept) {
+    luaL_error(L, "invalid method");
+  }
+  if (ud->rdrain) {
+    lws::ondrain(ud->handle, nullptr, nullptr);
+    luaC_unref(L, ud->rdrain);
+    ud->rdrain = 0;
+  }
+  if (lua_isnoneornil(L, 2)) {
+    lua_pushboolean(L, 1);
+    return 1;
+  }
   luaL_checktype(L, 2, LUA_TFUNCTION);
-  int rcb = luaC_ref(L, 2);
-  lws_int ok = lws::receive(ud->handle, [rcb](int ec, const char* data, lws_size size) {
+  int rdrain = luaC_ref(L, 2);
+  lws_int ok = lws::ondrain(ud->handle, on_drain, (lws_context)(intptr_t)rdrain);
+  if (ok == lws_true) {
+    ud->rdrain = rdrain;
+  }
+  else {
+    luaC_unref(L, rdrain);
+  }
+  lua_pushboolean(L, ok == lws_true ? 1 : 0);
+  return 1;
+}
+
+static lws_int receive_single(lws_int handle, int rcb) {
+  return lws::receive(handle, [rcb](int ec, const char* data, lws_size size) {
     lua_State* L = luaC_getlocal();
     revert_if_return revert(L);
     unref_if_return  unref_rcb(L, rcb);
@@ -234,6 +602,47 @@ static int luaf_receive(lua_State* L) {
       unref_rcb.cancel();
     }
   });
+}
+
+static lws_int receive_batch(lws_int handle, int rcb, lws_size max_count) {
+  return lws::recvbatch(handle, max_count, [rcb](int ec, const lws_slice* items, lws_size count) {
+    lua_State* L = luaC_getlocal();
+    revert_if_return revert(L);
+    unref_if_return  unref_rcb(L, rcb);
+    luaC_rawgeti(L, rcb);
+    if (lua_type(L, -1) != LUA_TFUNCTION) {
+      return;
+    }
+    lua_pushinteger(L, ec);
+    if (ec) {
+      lua_pushlstring(L, items->data, items->size);
+    }
+    else {
+      lua_createtable(L, (int)count, 0);
+      for (lws_size i = 0; i < count; i++) {
+        lua_pushlstring(L, items[i].data, items[i].size);
+        lua_rawseti(L, -2, (lua_Integer)i + 1);
+      }
+    }
+    if (luaC_xpcall(L, 2, 0) != LUA_OK) {
+      lua_ferror("%s\n", lua_tostring(L, -1));
+    }
+    if (!ec) {
+      unref_rcb.cancel();
+    }
+  });
+}
+
+static int luaf_receive(lua_State* L) {
+  auto ud = luaC_checkudata<ud_context>(L, 1, LUAC_SOCKET);
+  if (ud->accept) {
+    luaL_error(L, "invalid method");
+  }
+  luaL_checktype(L, 2, LUA_TFUNCTION);
+  lua_Integer batch = luaL_optinteger(L, 3, 0);
+  luaL_argcheck(L, batch >= 0, 3, "must be >= 0");
+  int rcb = luaC_ref(L, 2);
+  lws_int ok = batch > 0 ? receive_batch(ud->handle, rcb, (lws_size)batch) : receive_single(ud->handle, rcb);
   if (ok != lws_true) {
     luaC_unref(L, rcb);
   }
@@ -366,6 +775,156 @@ static int luaf_wwwget(lua_State* L) {
   return 1;
 }
 
+/* io.resolve(host) blocks on a miss, io.resolve(host, func) calls func(ec, list) later */
+static int luaf_resolve(lua_State* L) {
+  const char* host = luaL_checkstring(L, 1);
+  if (lua_isnoneornil(L, 2)) {
+    const char* addr = nullptr;
+    lws_int ok = lws::resolve(host, &addr);
+    if (ok != lws_true) {
+      lua_pushnil(L);
+      lua_pushstring(L, "host not found");
+      return 2;
+    }
+    lua_pushstring(L, addr);
+    return 1;
+  }
+  luaL_checktype(L, 2, LUA_TFUNCTION);
+  int rcb = luaC_ref(L, 2);
+  lws_int ok = lws::asyncresolve(host, [rcb](int ec, const lws_endinfo* items, lws_size count) {
+    lua_State* L = luaC_getlocal();
+    revert_if_return revert(L);
+    unref_if_return  unref_rcb(L, rcb);
+    luaC_rawgeti(L, rcb);
+    if (lua_type(L, -1) != LUA_TFUNCTION) {
+      return;
+    }
+    lua_pushinteger(L, ec);
+    if (ec) {
+      lua_pushstring(L, ec == EHOSTUNREACH ? "host not found" : std::system_category().message(ec).c_str());
+    }
+    else {
+      lua_createtable(L, (int)count, 0);
+      for (lws_size i = 0; i < count; i++) {
+        lua_pushstring(L, items[i].ip);
+        lua_rawseti(L, -2, (lua_Integer)i + 1);
+      }
+    }
+    if (luaC_xpcall(L, 2, 0) != LUA_OK) {
+      lua_ferror("%s\n", lua_tostring(L, -1));
+    }
+  });
+  if (ok != lws_true) {
+    luaC_unref(L, rcb);
+  }
+  lua_pushboolean(L, ok == lws_true ? 1 : 0);
+  return 1;
+}
+
+/* io.dnscache(ttl [, negative_ttl]) in ms, 0 turns caching off */
+static int luaf_dnscache(lua_State* L) {
+  lua_Integer ttl = luaL_checkinteger(L, 1);
+  lua_Integer negative_ttl = luaL_optinteger(L, 2, ttl < 5000 ? ttl : 5000);
+  luaL_argcheck(L, ttl >= 0, 1, "must be >= 0");
+  luaL_argcheck(L, negative_ttl >= 0, 2, "must be >= 0");
+  lws::dnscache((lws_size)ttl, (lws_size)negative_ttl);
+  return 0;
+}
+
+/* io.backend(), "epoll", "io_uring", "iocp", "kqueue" or "select" */
+static int luaf_backend(lua_State* L) {
+  lua_pushstring(L, lws::backend());
+  return 1;
+}
+
+/********************************************************************************/
+
+struct ud_group {
+  std::vector<lws_int> ids;
+  std::unordered_set<lws_int> members;
+};
+
+/* io.group(), sockets are kept by id and leave by themselves once closed */
+static int luaf_group(lua_State* L) {
+  luaC_newuserdata<ud_group>(L, LUAC_GROUP);
+  return 1;
+}
+
+static lws_int check_member(lua_State* L, int index) {
+  auto ud = (ud_context*)luaL_testudata(L, index, LUAC_SOCKET);
+  if (ud) {
+    return ud->handle;
+  }
+  return (lws_int)luaL_checkinteger(L, index);
+}
+
+static int luaf_group_gc(lua_State* L) {
+  auto ud = luaC_checkudata<ud_group>(L, 1, LUAC_GROUP);
+  ud->~ud_group();
+  return 0;
+}
+
+static int luaf_group_add(lua_State* L) {
+  auto ud = luaC_checkudata<ud_group>(L, 1, LUAC_GROUP);
+  lws_int id = check_member(L, 2);
+  bool added = id > 0 && lws::valid(id) == lws_true && ud->members.insert(id).second;
+  if (added) {
+    ud->ids.push_back(id);
+  }
+  lua_pushboolean(L, added ? 1 : 0);
+  return 1;
+}
+
+static int luaf_group_remove(lua_State* L) {
+  auto ud = luaC_checkudata<ud_group>(L, 1, LUAC_GROUP);
+  lws_int id = check_member(L, 2);
+  bool removed = ud->members.erase(id) > 0;
+  if (removed) {
+    for (auto iter = ud->ids.begin(); iter != ud->ids.end(); ++iter) {
+      if (*iter == id) {
+        *iter = ud->ids.back(); /* the order of members doesn't matter */
+        ud->ids.pop_back();
+        break;
+      }
+    }
+  }
+  lua_pushboolean(L, removed ? 1 : 0);
+  return 1;
+}
+
+static int luaf_group_clear(lua_State* L) {
+  auto ud = luaC_checkudata<ud_group>(L, 1, LUAC_GROUP);
+  ud->ids.clear();
+  ud->members.clear();
+  return 0;
+}
+
+static int luaf_group_size(lua_State* L) {
+  auto ud = luaC_checkudata<ud_group>(L, 1, LUAC_GROUP);
+  lua_pushinteger(L, (lua_Integer)ud->ids.size());
+  return 1;
+}
+
+/* frames the message once for all members, returns how many it went to */
+static int luaf_group_send(lua_State* L) {
+  size_t size;
+  auto ud = luaC_checkudata<ud_group>(L, 1, LUAC_GROUP);
+  const char* data = luaL_checklstring(L, 2, &size);
+  if (ud->ids.empty()) {
+    lua_pushinteger(L, 0);
+    return 1;
+  }
+  lws_size count = (lws_size)ud->ids.size();
+  lws::broadcast(ud->ids.data(), &count, data, size);
+  if (count < ud->ids.size()) {
+    ud->ids.resize(count);
+    ud->members.clear();
+    ud->members.insert(ud->ids.begin(), ud->ids.end());
+  }
+  lua_pushinteger(L, (lua_Integer)count);
+  return 1;
+}
+
 /********************************************************************************/
 
 static void init_metatable(lua_State* L) {
@@ -373,6 +932,7 @@ static void init_metatable(lua_State* L) {
     { "__gc",       luaf_gc         },
     { "close",      luaf_close      },
     { "valid",      luaf_valid      },
+    { "detach",     luaf_detach     },
     { "id",         luaf_id         },
     { "connect",    luaf_connect    },
     { "listen",     luaf_listen     },
@@ -382,6 +942,9 @@ static void init_metatable(lua_State* L) {
     { "write",      luaf_write      },
     { "send",       luaf_send       },
     { "receive",    luaf_receive    },
+    { "pending",    luaf_pending    },
+    { "watermark",  luaf_watermark  },
+    { "ondrain",    luaf_ondrain    },
     { "geturi",     luaf_geturi     },
     { "getheader",  luaf_getheader  },
     { "seturi",     luaf_seturi     },
@@ -390,6 +953,19 @@ static void init_metatable(lua_State* L) {
   };
   luaC_newmetatable(L, LUAC_SOCKET, methods);
   lua_pop(L, 1);
+
+  const luaL_Reg group_methods[] = {
+    { "__gc",       luaf_group_gc     },
+    { "__len",      luaf_group_size   },
+    { "add",        luaf_group_add    },
+    { "remove",     luaf_group_remove },
+    { "clear",      luaf_group_clear  },
+    { "size",       luaf_group_size   },
+    { "send",       luaf_group_send   },
+    { NULL,         NULL              }
+  };
+  luaC_newmetatable(L, LUAC_GROUP, group_methods);
+  lua_pop(L, 1);
 }
 
 LUAC_API int luaC_open_socket(lua_State* L) {
@@ -398,6 +974,11 @@ LUAC_API int luaC_open_socket(lua_State* L) {
     { "wwwget",   luaf_wwwget   },
     { "socket",   luaf_socket   },
     { "acceptor", luaf_acceptor },
+    { "adopt",    luaf_adopt    },
+    { "resolve",  luaf_resolve  },
+    { "dnscache", luaf_dnscache },
+    { "backend",  luaf_backend  },
+    { "group",    luaf_group    },
     { NULL,       NULL          }
   };
   lua_getglobal(L, "io");
@@ -6,6 +6,7 @@
 #include "luaf_string.h"
 #include "luaf_compile.h"
 #include "luaf_http.h"
+#include "luaf_httpc.h"
 #include "luaf_json.h"
 #include "luaf_leak.h"
 #include "luaf_list.h"
@@ -17,6 +18,7 @@
 #include "luaf_dir.h"
 #include "luaf_clock.h"
 #include "luaf_socket.h"
+#include "luaf_udp.h"
 #include "luaf_rpcall.h"
 #include "luaf_storage.h"
 
@@ -51,11 +53,13 @@ static const lua_CFunction modules[] = {
   luaC_open_string,
   luaC_open_print,
   luaC_open_http,
+  luaC_open_httpc,
   luaC_open_json,
   luaC_open_leak,
   luaf_open_list,
   luaC_open_pack,
   luaC_open_socket,
+  luaC_open_udp,
   luaC_open_timer,
   luaC_open_clock,
   luaC_open_dir,
@@ -0,0 +1,277 @@
+
+
+#include <string.h>
+#include <system_error>
+#include "luaf_udp.h"
+#include "socket.io/socket.io.hpp"
+
+#define LUAC_UDP "io:udp"
+
+/********************************************************************************/
+
+struct ud_udp {
+  lws_int handle;
+};
+
+/* io.udp([max_size]), longer datagrams are truncated */
+static int luaf_udp(lua_State* L) {
+  lua_Integer max_size = luaL_optinteger(L, 1, 65536);
+  luaL_argcheck(L, max_size > 0, 1, "must be > 0");
+  auto ud = luaC_newuserdata<ud_udp>(L, LUAC_UDP);
+  ud->handle = lws::udp((lws_size)max_size);
+  return 1;
+}
+
+static int luaf_close(lua_State* L) {
+  auto ud = luaC_checkudata<ud_udp>(L, 1, LUAC_UDP);
+  lws::close(ud->handle);
+  return 0;
+}
+
+static int luaf_gc(lua_State* L) {
+  if (luaC_debugging()) {
+    lua_ftrace("DEBUG: %s will gc\n", LUAC_UDP);
+  }
+  auto ud = luaC_checkudata<ud_udp>(L, 1, LUAC_UDP);
+  int result = luaf_close(L);
+  ud->~ud_udp();
+  return result;
+}
+
+static int luaf_id(lua_State* L) {
+  auto ud = luaC_checkudata<ud_udp>(L, 1, LUAC_UDP);
+  lua_pushinteger(L, ud->handle);
+  return 1;
+}
+
+static int luaf_valid(lua_State* L) {
+  auto ud = luaC_checkudata<ud_udp>(L, 1, LUAC_UDP);
+  lua_pushboolean(L, lws::valid(ud->handle));
+  return 1;
+}
+
+static int luaf_bind(lua_State* L) {
+  auto ud = luaC_checkudata<ud_udp>(L, 1, LUAC_UDP);
+  lws_ushort  port = (lws_ushort)luaL_checkinteger(L, 2);
+  const char* host = luaL_optstring(L, 3, nullptr);
+  lws_int ok = lws::udpbind(ud->handle, port, host);
+  lua_pushboolean(L, ok == lws_true ? 1 : 0);
+  return 1;
+}
+
+/* with func(ec) the name is resolved off the job's thread */
+static int luaf_connect(lua_State* L) {
+  auto ud = luaC_checkudata<ud_udp>(L, 1, LUAC_UDP);
+  const char* host = luaL_checkstring(L, 2);
+  lws_ushort  port = (lws_ushort)luaL_checkinteger(L, 3);
+  if (lua_isnoneornil(L, 4)) {
+    lws_int ok = lws::udpconnect(ud->handle, host, port);
+    lua_pushboolean(L, ok == lws_true ? 1 : 0);
+    return 1;
+  }
+  luaL_checktype(L, 4, LUA_TFUNCTION);
+  int rcb = luaC_ref(L, 4);
+  lws_int ok = lws::udpconnect(ud->handle, host, port, [rcb](int ec) {
+    lua_State* L = luaC_getlocal();
+    revert_if_return revert(L);
+    unref_if_return  unref_rcb(L, rcb);
+
+    luaC_rawgeti(L, rcb);
+    if (lua_type(L, -1) != LUA_TFUNCTION) {
+      return;
+    }
+    lua_pushinteger(L, ec);
+    if (luaC_xpcall(L, 1, 0) != LUA_OK) {
+      lua_ferror("%s\n", lua_tostring(L, -1));
+    }
+  });
+  if (ok != lws_true) {
+    luaC_unref(L, rcb);
+  }
+  lua_pushboolean(L, ok == lws_true ? 1 : 0);
+  return 1;
+}
+
+/* to the connected peer */
+static int luaf_send(lua_State* L) {
+  size_t size;
+  auto ud = luaC_checkudata<ud_udp>(L, 1, LUAC_UDP);
+  const char* data = luaL_checklstring(L, 2, &size);
+  lws_int ok = lws::sendto(ud->handle, data, size);
+  lua_pushboolean(L, ok == lws_true ? 1 : 0);
+  return 1;
+}
+
+/* ip is a numeric address, names are resolved by connect only */
+static int luaf_sendto(lua_State* L) {
+  size_t size;
+  auto ud = luaC_checkudata<ud_udp>(L, 1, LUAC_UDP);
+  const char* data = luaL_checklstring(L, 2, &size);
+  const char* ip   = luaL_checkstring(L, 3);
+  lws_ushort  port = (lws_ushort)luaL_checkinteger(L, 4);
+  lws_int ok = lws::sendto(ud->handle, data, size, ip, port);
+  lua_pushboolean(L, ok == lws_true ? 1 : 0);
+  return 1;
+}
+
+/* kernel buffer sizes after bind or connect, 0 keeps the current one */
+static int luaf_buffers(lua_State* L) {
+  auto ud = luaC_checkudata<ud_udp>(L, 1, LUAC_UDP);
+  lua_Integer recv = luaL_checkinteger(L, 2);
+  lua_Integer send = luaL_optinteger(L, 3, 0);
+  luaL_argcheck(L, recv >= 0, 2, "must be >= 0");
+  luaL_argcheck(L, send >= 0, 3, "must be >= 0");
+  lws_int ok = lws::udpbuffers(ud->handle, (lws_size)recv, (lws_size)send);
+  lua_pushboolean(L, ok == lws_true ? 1 : 0);
+  return 1;
+}
+
+static int luaf_pending(lua_State* L) {
+  auto ud = luaC_checkudata<ud_udp>(L, 1, LUAC_UDP);
+  lws_size bytes = 0;
+  lws_int ok = lws::pending(ud->handle, &bytes);
+  lua_pushinteger(L, ok == lws_true ? (lua_Integer)bytes : 0);
+  return 1;
+}
+
+static int luaf_watermark(lua_State* L) {
+  auto ud = luaC_checkudata<ud_udp>(L, 1, LUAC_UDP);
+  lua_Integer high = luaL_checkinteger(L, 2);
+  luaL_argcheck(L, high >= 0, 2, "must be >= 0");
+  lws_int ok = lws::watermark(ud->handle, (lws_size)high, (lws_size)high);
+  lua_pushboolean(L, ok == lws_true ? 1 : 0);
+  return 1;
+}
+
+static int luaf_endpoint(lua_State* L) {
+  auto ud = luaC_checkudata<ud_udp>(L, 1, LUAC_UDP);
+  lws_endtype type   = lws_endtype::local;
+  const char* option = luaL_optstring(L, 2, "local");
+  if (strcmp(option, "remote") == 0) {
+    type = lws_endtype::remote;
+  }
+  lws_endinfo info;
+  lws_int ok = lws::endpoint(ud->handle, &info, type);
+  if (ok == lws_true) {
+    lua_pushstring (L, info.ip);
+    lua_pushinteger(L, info.port);
+  }
+  else {
+    lua_pushnil(L);
+    lua_pushnil(L);
+  }
+  return 2;
+}
+
+/* func(ec, data, ip, port) for each datagram, or func(ec, list, ips, ports) with batch > 0 */
+static lws_int receive_from(lws_int handle, int rcb, lws_size max_count, bool batch) {
+  return lws::udprecv(handle, max_count, [rcb, batch](int ec, const lws_datagram* items, lws_size count) {
+    lua_State* L = luaC_getlocal();
+    revert_if_return revert(L);
+    unref_if_return  unref_rcb(L, rcb);
+    if (!ec) {
+      unref_rcb.cancel();
+    }
+    if (ec) {
+      luaC_rawgeti(L, rcb);
+      if (lua_type(L, -1) != LUA_TFUNCTION) {
+        return;
+      }
+      lua_pushinteger(L, ec);
+      lua_pushstring(L, std::system_category().message(ec).c_str());
+      if (luaC_xpcall(L, 2, 0) != LUA_OK) {
+        lua_ferror("%s\n", lua_tostring(L, -1));
+      }
+      return;
+    }
+    if (batch) {
+      luaC_rawgeti(L, rcb);
+      if (lua_type(L, -1) != LUA_TFUNCTION) {
+        return;
+      }
+      lua_pushinteger(L, 0);
+      lua_createtable(L, (int)count, 0);
+      lua_createtable(L, (int)count, 0);
+      lua_createtable(L, (int)count, 0);
+      for (lws_size i = 0; i < count; i++) {
+        lua_pushlstring(L, items[i].data, items[i].size);
+        lua_rawseti(L, -4, (lua_Integer)i + 1);
+        lua_pushstring(L, items[i].from.ip);
+        lua_rawseti(L, -3, (lua_Integer)i + 1);
+        lua_pushinteger(L, items[i].from.port);
+        lua_rawseti(L, -2, (lua_Integer)i + 1);
+      }
+      if (luaC_xpcall(L, 4, 0) != LUA_OK) {
+        lua_ferror("%s\n", lua_tostring(L, -1));
+      }
+      return;
+    }
+    for (lws_size i = 0; i < count; i++) {
+      luaC_rawgeti(L, rcb);
+      if (lua_type(L, -1) != LUA_TFUNCTION) {
+        lua_pop(L, 1);
+        return;
+      }
+      lua_pushinteger(L, 0);
+      lua_pushlstring(L, items[i].data, items[i].size);
+      lua_pushstring(L, items[i].from.ip);
+      lua_pushinteger(L, items[i].from.port);
+      if (luaC_xpcall(L, 4, 0) != LUA_OK) {
+        lua_ferror("%s\n", lua_tostring(L, -1));
+        lua_pop(L, 1);
+      }
+    }
+  });
+}
+
+static int luaf_receive(lua_State* L) {
+  auto ud = luaC_checkudata<ud_udp>(L, 1, LUAC_UDP);
+  luaL_checktype(L, 2, LUA_TFUNCTION);
+  lua_Integer batch = luaL_optinteger(L, 3, 0);
+  luaL_argcheck(L, batch >= 0, 3, "must be >= 0");
+  int rcb = luaC_ref(L, 2);
+  /* without batch the datagrams of one read are still taken together */
+  lws_int ok = receive_from(ud->handle, rcb, batch > 0 ? (lws_size)batch : 32, batch > 0);
+  if (ok != lws_true) {
+    luaC_unref(L, rcb);
+  }
+  lua_pushboolean(L, ok == lws_true ? 1 : 0);
+  return 1;
+}
+
+/********************************************************************************/
+
+static void init_metatable(lua_State* L) {
+  const luaL_Reg methods[] = {
+    { "__gc",       luaf_gc         },
+    { "close",      luaf_close      },
+    { "valid",      luaf_valid      },
+    { "id",         luaf_id         },
+    { "bind",       luaf_bind       },
+    { "connect",    luaf_connect    },
+    { "send",       luaf_send       },
+    { "sendto",     luaf_sendto     },
+    { "receive",    luaf_receive    },
+    { "pending",    luaf_pending    },
+    { "watermark",  luaf_watermark  },
+    { "buffers",    luaf_buffers    },
+    { "endpoint",   luaf_endpoint   },
+    { NULL,         NULL            }
+  };
+  luaC_newmetatable(L, LUAC_UDP, methods);
+  lua_pop(L, 1);
+}
+
+LUAC_API int luaC_open_udp(lua_State* L) {
+  init_metatable(L);
+  const luaL_Reg methods[] = {
+    { "udp",        luaf_udp        },
+    { NULL,         NULL            }
+  };
+  lua_getglobal(L, "io");
+  luaL_setfuncs(L, methods, 0);
+  lua_pop(L, 1); /* pop 'io' from stack */
+  return 0;
+}
+
+/********************************************************************************/
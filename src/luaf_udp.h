@@ -0,0 +1,13 @@
+
+
+#pragma once
+
+/********************************************************************************/
+
+#include "luaf_state.h"
+
+/********************************************************************************/
+
+LUAC_API int luaC_open_udp(lua_State* L);
+
+/********************************************************************************/
@@ -0,0 +1,496 @@
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "include/rapidjson.h"
+#include "include/reader.h"
+#include "include/writer.h"
+#include "include/prettywriter.h"
+#include "include/stringbuffer.h"
+#include "include/error/en.h"
+
+#include "luax.hpp"
+#include "msgpack.hpp"
+#include "stringstream.hpp"
+
+using namespace rapidjson;
+
+
+namespace msgpack {
+
+	static const int MAX_DEPTH_DEFAULT = 128;
+
+	/**
+	* Same rule as the Lua side: a double without fraction is an integer.
+	*/
+	static bool isinteger(double d, int64_t* out)
+	{
+		double intpart;
+		if (std::modf(d, &intpart) != 0.0)
+			return false;
+		if (intpart < static_cast<double>(std::numeric_limits<int64_t>::min())
+			|| intpart >= static_cast<double>(std::numeric_limits<int64_t>::max()))
+			return false;
+		*out = static_cast<int64_t>(intpart);
+		return true;
+	}
+
+	/**
+	* SAX handler that writes msgpack while rapidjson reads JSON.
+	* Containers get a 5 bytes header reserved when they start; it is
+	* shrunk to the smallest form once the element count is known.
+	*/
+	class Encoder : public BaseReaderHandler<UTF8<>, Encoder> {
+		std::string& out;
+		std::vector<size_t> marks;
+
+		void put(unsigned char c) {
+			out.push_back(static_cast<char>(c));
+		}
+
+		void putBE(uint64_t v, int n) {
+			for (int i = n - 1; i >= 0; --i)
+				put(static_cast<unsigned char>(v >> (i * 8)));
+		}
+
+		bool close(unsigned char fix, unsigned char c16, unsigned char c32, SizeType n) {
+			unsigned char hdr[5];
+			size_t len;
+			if (n <= 15) {
+				hdr[0] = static_cast<unsigned char>(fix | n);
+				len = 1;
+			}
+			else if (n <= 0xffff) {
+				hdr[0] = c16;
+				hdr[1] = static_cast<unsigned char>(n >> 8);
+				hdr[2] = static_cast<unsigned char>(n);
+				len = 3;
+			}
+			else {
+				hdr[0] = c32;
+				hdr[1] = static_cast<unsigned char>(n >> 24);
+				hdr[2] = static_cast<unsigned char>(n >> 16);
+				hdr[3] = static_cast<unsigned char>(n >> 8);
+				hdr[4] = static_cast<unsigned char>(n);
+				len = 5;
+			}
+			size_t pos = marks.back();
+			marks.pop_back();
+			if (len < 5)
+				out.erase(pos + len, 5 - len);
+			out.replace(pos, len, reinterpret_cast<const char*>(hdr), len);
+			return true;
+		}
+
+	public:
+		explicit Encoder(std::string& o) : out(o) {}
+
+		bool Null() {
+			put(0xc0);
+			return true;
+		}
+
+		bool Bool(bool b) {
+			put(b ? 0xc3 : 0xc2);
+			return true;
+		}
+
+		bool Int(int i) {
+			return Int64(i);
+		}
+
+		bool Uint(unsigned u) {
+			return Int64(u);
+		}
+
+		bool Int64(int64_t n) {
+			if (n >= 0) {
+				if (n <= 127) put(static_cast<unsigned char>(n));
+				else if (n <= 0xff) { put(0xcc); putBE(n, 1); }
+				else if (n <= 0xffff) { put(0xcd); putBE(n, 2); }
+				else if (n <= 0xffffffffLL) { put(0xce); putBE(n, 4); }
+				else { put(0xcf); putBE(n, 8); }
+			}
+			else {
+				if (n >= -32) put(static_cast<unsigned char>(n));
+				else if (n >= -128) { put(0xd0); putBE(n, 1); }
+				else if (n >= -32768) { put(0xd1); putBE(n, 2); }
+				else if (n >= -2147483648LL) { put(0xd2); putBE(n, 4); }
+				else { put(0xd3); putBE(n, 8); }
+			}
+			return true;
+		}
+
+		bool Uint64(uint64_t u) {
+			if (u <= static_cast<uint64_t>(std::numeric_limits<int64_t>::max()))
+				return Int64(static_cast<int64_t>(u));
+			put(0xcf);
+			putBE(u, 8);
+			return true;
+		}
+
+		bool Double(double d) {
+			int64_t integer;
+			if (isinteger(d, &integer))
+				return Int64(integer);
+
+			float f = static_cast<float>(d);
+			if (d == static_cast<double>(f)) {
+				uint32_t bits;
+				memcpy(&bits, &f, 4);
+				put(0xca);
+				putBE(bits, 4);
+			}
+			else {
+				uint64_t bits;
+				memcpy(&bits, &d, 8);
+				put(0xcb);
+				putBE(bits, 8);
+			}
+			return true;
+		}
+
+		bool String(const char* s, SizeType len, bool) {
+			if (len < 32) put(static_cast<unsigned char>(0xa0 | len));
+			else if (len <= 0xff) { put(0xd9); putBE(len, 1); }
+			else if (len <= 0xffff) { put(0xda); putBE(len, 2); }
+			else { put(0xdb); putBE(len, 4); }
+			out.append(s, len);
+			return true;
+		}
+
+		bool Key(const char* s, SizeType len, bool copy) {
+			return String(s, len, copy);
+		}
+
+		bool StartObject() {
+			marks.push_back(out.size());
+			out.append(5, '\0');
+			return true;
+		}
+
+		bool EndObject(SizeType n) {
+			return close(0x80, 0xde, 0xdf, n);
+		}
+
+		bool StartArray() {
+			marks.push_back(out.size());
+			out.append(5, '\0');
+			return true;
+		}
+
+		bool EndArray(SizeType n) {
+			return close(0x90, 0xdc, 0xdd, n);
+		}
+	};
+
+
+	enum TokenType {
+		T_NIL, T_BOOL, T_INT, T_UINT, T_DOUBLE, T_STRING, T_ARRAY, T_MAP
+	};
+
+	struct Token {
+		TokenType type;
+		bool boolean;
+		int64_t integer;
+		uint64_t uinteger;
+		double number;
+		const char* str;
+		size_t size; // string length or element count
+	};
+
+	/**
+	* Reads msgpack tokens and replays them on a rapidjson Writer.
+	* Follows what json.encode(unwrap(s)) would produce: non-string map keys
+	* are skipped and empty containers become {} unless empty_table_as_array.
+	*/
+	template<typename Writer>
+	class Decoder {
+		const unsigned char* p;
+		size_t left;
+		Writer& writer;
+		bool empty_table_as_array;
+		int max_depth;
+
+	public:
+		const char* error;
+
+		Decoder(const char* s, size_t len, Writer& w, bool empty_as_array, int depth)
+			: p(reinterpret_cast<const unsigned char*>(s)), left(len), writer(w)
+			, empty_table_as_array(empty_as_array), max_depth(depth), error(NULL) {}
+
+		bool value(int depth = 0) {
+			Token t;
+			if (!next(t))
+				return false;
+			return emit(t, depth);
+		}
+
+	private:
+		bool fail(const char* msg) {
+			if (!error)
+				error = msg;
+			return false;
+		}
+
+		bool need(size_t n) {
+			return left >= n ? true : fail("missing bytes in input");
+		}
+
+		uint64_t readBE(size_t offset, int n) {
+			uint64_t v = 0;
+			for (int i = 0; i < n; ++i)
+				v = (v << 8) | p[offset + i];
+			return v;
+		}
+
+		void consume(size_t n) {
+			p += n;
+			left -= n;
+		}
+
+		bool sized(Token& t, TokenType type, size_t hdr, int n) {
+			if (!need(hdr))
+				return false;
+			t.type = type;
+			t.size = static_cast<size_t>(readBE(hdr - n, n));
+			consume(hdr);
+			if (type == T_STRING) {
+				if (!need(t.size))
+					return false;
+				t.str = reinterpret_cast<const char*>(p);
+				consume(t.size);
+			}
+			return true;
+		}
+
+		bool next(Token& t) {
+			if (!need(1))
+				return false;
+			unsigned char c = p[0];
+			if (c <= 0x7f) {
+				t.type = T_INT;
+				t.integer = c;
+				consume(1);
+				return true;
+			}
+			if (c >= 0xe0) {
+				t.type = T_INT;
+				t.integer = static_cast<signed char>(c);
+				consume(1);
+				return true;
+			}
+			if ((c & 0xe0) == 0xa0) {
+				t.type = T_STRING;
+				t.size = c & 0x1f;
+				consume(1);
+				if (!need(t.size))
+					return false;
+				t.str = reinterpret_cast<const char*>(p);
+				consume(t.size);
+				return true;
+			}
+			if ((c & 0xf0) == 0x90 || (c & 0xf0) == 0x80) {
+				t.type = (c & 0xf0) == 0x90 ? T_ARRAY : T_MAP;
+				t.size = c & 0x0f;
+				consume(1);
+				return true;
+			}
+			switch (c) {
+			case 0xc0:
+				t.type = T_NIL;
+				consume(1);
+				return true;
+			case 0xc2:
+			case 0xc3:
+				t.type = T_BOOL;
+				t.boolean = (c == 0xc3);
+				consume(1);
+				return true;
+			case 0xcc: case 0xcd: case 0xce: case 0xcf: {
+				int n = 1 << (c - 0xcc);
+				if (!need(1 + n))
+					return false;
+				t.type = T_UINT;
+				t.uinteger = readBE(1, n);
+				consume(1 + n);
+				return true;
+			}
+			case 0xd0: case 0xd1: case 0xd2: case 0xd3: {
+				int n = 1 << (c - 0xd0);
+				if (!need(1 + n))
+					return false;
+				uint64_t v = readBE(1, n);
+				int shift = 64 - n * 8;
+				t.type = T_INT;
+				t.integer = shift ? (static_cast<int64_t>(v << shift) >> shift) : static_cast<int64_t>(v);
+				consume(1 + n);
+				return true;
+			}
+			case 0xca: {
+				if (!need(5))
+					return false;
+				uint32_t bits = static_cast<uint32_t>(readBE(1, 4));
+				float f;
+				memcpy(&f, &bits, 4);
+				t.type = T_DOUBLE;
+				t.number = f;
+				consume(5);
+				return true;
+			}
+			case 0xcb: {
+				if (!need(9))
+					return false;
+				uint64_t bits = readBE(1, 8);
+				memcpy(&t.number, &bits, 8);
+				t.type = T_DOUBLE;
+				consume(9);
+				return true;
+			}
+			case 0xd9: case 0xc4: return sized(t, T_STRING, 2, 1);
+			case 0xda: case 0xc5: return sized(t, T_STRING, 3, 2);
+			case 0xdb: case 0xc6: return sized(t, T_STRING, 5, 4);
+			case 0xdc: return sized(t, T_ARRAY, 3, 2);
+			case 0xdd: return sized(t, T_ARRAY, 5, 4);
+			case 0xde: return sized(t, T_MAP, 3, 2);
+			case 0xdf: return sized(t, T_MAP, 5, 4);
+			default:
+				return fail("unsupported msgpack type");
+			}
+		}
+
+		bool skip(const Token& t, int depth) {
+			if (depth > max_depth)
+				return fail("nested too depth");
+			size_t count = t.type == T_ARRAY ? t.size : (t.type == T_MAP ? t.size * 2 : 0);
+			for (size_t i = 0; i < count; ++i) {
+				Token child;
+				if (!next(child) || !skip(child, depth + 1))
+					return false;
+			}
+			return true;
+		}
+
+		bool emit(const Token& t, int depth) {
+			if (depth > max_depth)
+				return fail("nested too depth");
+			int64_t integer;
+			switch (t.type) {
+			case T_NIL:
+				return writer.Null();
+			case T_BOOL:
+				return writer.Bool(t.boolean);
+			case T_INT:
+				return writer.Int64(t.integer);
+			case T_UINT:
+				return writer.Uint64(t.uinteger);
+			case T_DOUBLE:
+				if (isinteger(t.number, &integer))
+					return writer.Int64(integer);
+				return writer.Double(t.number) ? true : fail("error while encode double value");
+			case T_STRING:
+				return writer.String(t.str, static_cast<SizeType>(t.size));
+			case T_ARRAY:
+				if (t.size == 0 && !empty_table_as_array) {
+					writer.StartObject();
+					return writer.EndObject();
+				}
+				writer.StartArray();
+				for (size_t i = 0; i < t.size; ++i) {
+					if (!value(depth + 1))
+						return false;
+				}
+				return writer.EndArray();
+			case T_MAP:
+				if (t.size == 0 && empty_table_as_array) {
+					writer.StartArray();
+					return writer.EndArray();
+				}
+				writer.StartObject();
+				for (size_t i = 0; i < t.size; ++i) {
+					Token key;
+					if (!next(key))
+						return false;
+					if (key.type != T_STRING) {
+						Token val;
+						if (!skip(key, depth + 1) || !next(val) || !skip(val, depth + 1))
+							return false;
+						continue;
+					}
+					writer.Key(key.str, static_cast<SizeType>(key.size));
+					if (!value(depth + 1))
+						return false;
+				}
+				return writer.EndObject();
+			}
+			return fail("unsupported msgpack type");
+		}
+	};
+
+
+	/**
+	* json.to_msgpack(str)
+	* Returns the msgpack string, or nil and the parse error.
+	*/
+	int to_msgpack(lua_State* L)
+	{
+		size_t len = 0;
+		const char* contents = luaL_checklstring(L, 1, &len);
+
+		std::string out;
+		out.reserve(len);
+		Encoder handler(out);
+		Reader reader;
+		extend::StringStream s(contents, len);
+		ParseResult r = reader.Parse(s, handler);
+		if (!r) {
+			lua_pushnil(L);
+			lua_pushfstring(L, "%s (%d)", GetParseError_En(r.Code()), r.Offset());
+			return 2;
+		}
+		lua_pushlstring(L, out.data(), out.size());
+		return 1;
+	}
+
+	template<typename Writer>
+	static int transcode(lua_State* L, const char* s, size_t len, StringBuffer& buffer, bool empty_as_array, int depth)
+	{
+		Writer writer(buffer);
+		Decoder<Writer> decoder(s, len, writer, empty_as_array, depth);
+		if (!decoder.value()) {
+			lua_pushnil(L);
+			lua_pushstring(L, decoder.error ? decoder.error : "error while encoding");
+			return 2;
+		}
+		lua_pushlstring(L, buffer.GetString(), buffer.GetSize());
+		return 1;
+	}
+
+	/**
+	* json.from_msgpack(str [, options])
+	* Transcodes the first value of a wrap()ed string to JSON text.
+	* options: pretty, empty_table_as_array, max_depth (as json.encode).
+	*/
+	int from_msgpack(lua_State* L)
+	{
+		size_t len = 0;
+		const char* contents = luaL_checklstring(L, 1, &len);
+
+		bool pretty = false;
+		bool empty_as_array = false;
+		int depth = MAX_DEPTH_DEFAULT;
+		if (!lua_isnoneornil(L, 2)) {
+			luaL_checktype(L, 2, LUA_TTABLE);
+			pretty = luax::optboolfield(L, 2, "pretty", false);
+			empty_as_array = luax::optboolfield(L, 2, "empty_table_as_array", false);
+			depth = luax::optintfield(L, 2, "max_depth", MAX_DEPTH_DEFAULT);
+		}
+
+		StringBuffer buffer;
+		if (pretty)
+			return transcode<PrettyWriter<StringBuffer> >(L, contents, len, buffer, empty_as_array, depth);
+		return transcode<Writer<StringBuffer> >(L, contents, len, buffer, empty_as_array, depth);
+	}
+}
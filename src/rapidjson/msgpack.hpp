@@ -0,0 +1,15 @@
+#ifndef __LUA_RAPIDJSON_MSGPACK_HPP__
+#define __LUA_RAPIDJSON_MSGPACK_HPP__
+
+#include <lua.hpp>
+
+/**
+* Transcoding between JSON text and the msgpack format used by wrap/unwrap.
+* Both directions run in C++ only, no Lua table is built on the way.
+*/
+namespace msgpack {
+	int to_msgpack(lua_State* L);
+	int from_msgpack(lua_State* L);
+}
+
+#endif // __LUA_RAPIDJSON_MSGPACK_HPP__
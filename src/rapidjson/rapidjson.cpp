@@ -3,12 +3,17 @@
 #include <vector>
 #include <algorithm>
 
-// __SSE2__ and __SSE4_2__ are recognized by gcc, clang, and the Intel compiler.
-// We use -march=native with gmake to enable -msse2 and -msse4.2, if supported.
-#if defined(__SSE4_2__)
-#  define RAPIDJSON_SSE42
-#elif defined(__SSE2__)
-#  define RAPIDJSON_SSE2
+// The Makefile defines RAPIDJSON_SSE42/RAPIDJSON_NEON for every source file, so
+// all translation units agree on the reader. This is only a fallback for builds
+// that pass -msse4.2 (or target NEON) without it.
+#if !defined(RAPIDJSON_SSE42) && !defined(RAPIDJSON_SSE2) && !defined(RAPIDJSON_NEON)
+#  if defined(__SSE4_2__)
+#    define RAPIDJSON_SSE42
+#  elif defined(__SSE2__)
+#    define RAPIDJSON_SSE2
+#  elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#    define RAPIDJSON_NEON
+#  endif
 #endif
 
 #include "include/document.h"
@@ -29,6 +34,9 @@
 #include "values.hpp"
 #include "luax.hpp"
 #include "file.hpp"
+#include "msgpack.hpp"
+#include "stream.hpp"
+#include "schema.hpp"
 #include "stringstream.hpp"
 
 using namespace rapidjson;
@@ -86,14 +94,71 @@ static int json_array(lua_State* L)
 	return makeTableType(L, 1, "json.array", "array");
 }
 
-static int json_decode(lua_State* L)
+/**
+* An object reused by every json.encode/json.decode call on the same thread.
+* A nested call (from a metamethod or a finalizer) gets a private instance,
+* and an instance that grew past `limit` bytes is given back to the system.
+*/
+template<typename T>
+class Reusable {
+public:
+	Reusable() : owner(!busy()) {
+		if (owner)
+			busy() = true;
+	}
+	~Reusable() {
+		if (owner)
+			busy() = false;
+	}
+	T& get() {
+		return owner ? shared() : local;
+	}
+	void trim(size_t used, size_t limit) {
+		if (owner && used > limit) {
+			shared().~T();
+			new (&shared()) T();
+		}
+	}
+
+private:
+	static T& shared() {
+		static thread_local T value;
+		return value;
+	}
+	static bool& busy() {
+		static thread_local bool value = false;
+		return value;
+	}
+	bool owner;
+	T local;
+};
+
+static const size_t REUSE_LIMIT = 1024 * 1024;
+
+/**
+* Runs f(L) under lua_pcall so that the Reusable guard of the caller is
+* released before an error is propagated with lua_error.
+*/
+static int protectedCall(lua_State* L, lua_CFunction f, void* state, int nargs, int nresults)
+{
+	lua_settop(L, nargs);
+	lua_pushcfunction(L, f);
+	lua_insert(L, 1);
+	lua_pushlightuserdata(L, state);
+	return lua_pcall(L, nargs + 1, nresults, 0);
+}
+
+static int decode_protected(lua_State* L)
 {
 	size_t len = 0;
 	const char*  contents = nullptr;
+	Reader* reader = reinterpret_cast<Reader*>(lua_touserdata(L, 3));
 	switch(lua_type(L, 1)) {
-	case LUA_TSTRING:
-		contents = luaL_checklstring(L, 1, &len);
-		break;
+	case LUA_TSTRING: {
+		/* lua strings end with a NUL, which lets rapidjson's SIMD scans run */
+		rapidjson::StringStream s(lua_tostring(L, 1));
+		return values::pushDecoded(L, s, *reader);
+	}
 	case LUA_TLIGHTUSERDATA:
 		contents = reinterpret_cast<const char*>(lua_touserdata(L, 1));
 		len = luaL_checkinteger(L, 2);
@@ -103,7 +168,19 @@ static int json_decode(lua_State* L)
 	}
 
 	rapidjson::extend::StringStream s(contents, len);
-	return values::pushDecoded(L, s);
+	return values::pushDecoded(L, s, *reader);
+}
+
+static int json_decode(lua_State* L)
+{
+	int status;
+	{
+		Reusable<Reader> reader;
+		status = protectedCall(L, decode_protected, &reader.get(), 2, LUA_MULTRET);
+	}
+	if (status != LUA_OK)
+		return lua_error(L);
+	return lua_gettop(L);
 }
 
 
@@ -143,10 +220,15 @@ class Encoder {
 	bool sort_keys;
 	bool empty_table_as_array;
 	int max_depth;
+	std::vector<Key> local_keys;
+	std::vector<Key>* keys;
 	static const int MAX_DEPTH_DEFAULT = 128;
 public:
-	Encoder(lua_State*L, int opt) : pretty(false), sort_keys(false), empty_table_as_array(false), max_depth(MAX_DEPTH_DEFAULT)
+	Encoder(lua_State*L, int opt, std::vector<Key>* reuse = NULL) : pretty(false), sort_keys(false), empty_table_as_array(false), max_depth(MAX_DEPTH_DEFAULT)
 	{
+		// sorting collects the keys of every nested object in one vector
+		keys = reuse ? reuse : &local_keys;
+
 		if (lua_isnoneornil(L, opt))
 			return;
 		luaL_checktype(L, opt, LUA_TTABLE);
@@ -225,8 +307,7 @@ private:
 		}
 
 
-		std::vector<Key> keys;
-		keys.reserve(luax::rawlen(L, idx));
+		size_t first = keys->size();
         lua_pushnil(L); // [nil]
 		while (lua_next(L, idx))
 		{
@@ -236,7 +317,7 @@ private:
 			{
 				size_t len = 0;
 				const char* key = lua_tolstring(L, -2, &len);
-				keys.push_back(Key(key, static_cast<SizeType>(len)));
+				keys->push_back(Key(key, static_cast<SizeType>(len)));
 			}
 
 			// pop value, leaving original key
@@ -244,7 +325,8 @@ private:
 			// [key]
 		}
 		// []
-		encodeObject(L, writer, idx, depth, keys);
+		encodeObject(L, writer, idx, depth, first);
+		keys->erase(keys->begin() + first, keys->end());
 	}
 
 	template<typename Writer>
@@ -275,21 +357,22 @@ private:
 	}
 
 	template<typename Writer>
-	void encodeObject(lua_State* L, Writer* writer, int idx, int depth, std::vector<Key> &keys)
+	void encodeObject(lua_State* L, Writer* writer, int idx, int depth, size_t first)
 	{
 		// []
 		idx = luax::absindex(L, idx);
 		writer->StartObject();
 
-		std::sort(keys.begin(), keys.end());
+		size_t last = keys->size();
+		std::sort(keys->begin() + first, keys->end());
 
-		std::vector<Key>::const_iterator i = keys.begin();
-		std::vector<Key>::const_iterator e = keys.end();
-		for (; i != e; ++i)
+		// nested objects append to the vector, so address the keys by index
+		for (size_t i = first; i != last; ++i)
 		{
-			writer->Key(i->key, static_cast<SizeType>(i->size));
-			lua_pushlstring(L, i->key, i->size); // [key]
-			lua_gettable(L, idx); // [value]
+			Key key = (*keys)[i];
+			writer->Key(key.key, static_cast<SizeType>(key.size));
+			lua_pushlstring(L, key.key, key.size); // [key]
+			lua_rawget(L, idx); // [value]
 			encodeValue(L, writer, -1, depth);
 			lua_pop(L, 1); // []
 		}
@@ -329,16 +412,37 @@ public:
 			encodeValue(L, &writer, idx);
 		}
 	}
+
+	template<typename Stream>
+	void encode(lua_State* L, Stream* s, Writer<Stream>* writer, int idx)
+	{
+		if (pretty)
+			return encode(L, s, idx);
+
+		writer->Reset(*s);
+		encodeValue(L, writer, idx);
+	}
 };
 
 
-static int json_encode(lua_State* L)
+/**
+* Everything json.encode needs that survives between calls.
+*/
+struct EncodeState {
+	StringBuffer buffer;
+	Writer<StringBuffer> writer;
+	std::vector<Key> keys;
+};
+
+static int encode_protected(lua_State* L)
 {
+	EncodeState* state = reinterpret_cast<EncodeState*>(lua_touserdata(L, 3));
 	try{
-		Encoder encode(L, 2);
-		StringBuffer s;
-		encode.encode(L, &s, 1);
-		lua_pushlstring(L, s.GetString(), s.GetSize());
+		Encoder encode(L, 2, &state->keys);
+		state->buffer.Clear();
+		state->keys.clear();
+		encode.encode(L, &state->buffer, &state->writer, 1);
+		lua_pushlstring(L, state->buffer.GetString(), state->buffer.GetSize());
 		return 1;
 	}
 	catch (...) {
@@ -347,6 +451,19 @@ static int json_encode(lua_State* L)
 	return 0;
 }
 
+static int json_encode(lua_State* L)
+{
+	int status;
+	{
+		Reusable<EncodeState> state;
+		status = protectedCall(L, encode_protected, &state.get(), 2, 1);
+		state.trim(state.get().buffer.GetSize(), REUSE_LIMIT);
+	}
+	if (status != LUA_OK)
+		return lua_error(L);
+	return 1;
+}
+
 
 static int json_dump(lua_State* L)
 {
@@ -386,6 +503,10 @@ static const luaL_Reg methods[] = {
 	{ "load", json_load },
 	{ "dump", json_dump },
 
+	// string <--> msgpack string
+	{ "to_msgpack", msgpack::to_msgpack },
+	{ "from_msgpack", msgpack::from_msgpack },
+
 	// special functions
 	{ "object", json_object },
 	{ "array", json_array },
@@ -395,6 +516,9 @@ static const luaL_Reg methods[] = {
 	{ "SchemaDocument", Userdata<SchemaDocument>::create },
 	{ "SchemaValidator", Userdata<SchemaValidator>::create },
 
+	// incremental parser
+	{ "stream", Userdata<JsonStream>::create },
+
 	{NULL, NULL }
 };
 
@@ -412,11 +536,15 @@ int luaL_rapidjson(lua_State* L)
   values::push_null(L); // [rapidjson, json.null]
   lua_setfield(L, -2, "null"); // [rapidjson]
 
+	schema::push_registry(L); // [rapidjson, json.schema]
+	lua_setfield(L, -2, "schema"); // [rapidjson]
+
 	createSharedMeta(L, "json.object", "object");
 	createSharedMeta(L, "json.array", "array");
 
 	Userdata<Document>::luaopen(L);
 	Userdata<SchemaDocument>::luaopen(L);
 	Userdata<SchemaValidator>::luaopen(L);
+	Userdata<JsonStream>::luaopen(L);
 	return 1;
 }
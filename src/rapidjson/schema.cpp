@@ -1,3 +1,9 @@
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <cstdio>
 #include <lua.hpp>
 
 #include "include/document.h"
@@ -5,9 +11,11 @@
 #include "include/istreamwrapper.h"
 #include "include/schema.h"
 #include "include/stringbuffer.h"
+#include "include/writer.h"
 
 #include "userdata.hpp"
 #include "values.hpp"
+#include "schema.hpp"
 
 using namespace rapidjson;
 
@@ -119,3 +127,208 @@ const luaL_Reg* Userdata<SchemaValidator>::methods() {
 	};
 	return reg;
 }
+
+
+namespace schema {
+
+	typedef std::shared_ptr<const SchemaDocument> SharedSchema;
+
+	static std::mutex _mutex;
+	static std::map<std::string, SharedSchema> _registry;
+	static std::atomic<size_t> _generation(0);
+
+	/**
+	* Validators of the calling thread, rebuilt only when the registry
+	* changed since they were created.
+	*/
+	struct PooledValidator {
+		SharedSchema schema;
+		std::unique_ptr<SchemaValidator> validator;
+	};
+
+	struct ValidatorPool {
+		size_t generation = 0;
+		std::map<std::string, PooledValidator> validators;
+	};
+
+	static ValidatorPool& local_pool() {
+		static thread_local ValidatorPool pool;
+		return pool;
+	}
+
+	static SharedSchema find(const std::string& name) {
+		std::unique_lock<std::mutex> lock(_mutex);
+		auto iter = _registry.find(name);
+		return iter == _registry.end() ? SharedSchema() : iter->second;
+	}
+
+	static SchemaValidator* acquire(const std::string& name) {
+		ValidatorPool& pool = local_pool();
+		size_t generation = _generation.load(std::memory_order_acquire);
+		if (pool.generation != generation) {
+			// something was registered or removed, keep only what is still current
+			for (auto iter = pool.validators.begin(); iter != pool.validators.end(); ) {
+				if (find(iter->first) != iter->second.schema)
+					iter = pool.validators.erase(iter);
+				else
+					++iter;
+			}
+			pool.generation = generation;
+		}
+		auto iter = pool.validators.find(name);
+		if (iter != pool.validators.end())
+			return iter->second.validator.get();
+
+		SharedSchema sd = find(name);
+		if (!sd)
+			return NULL;
+		PooledValidator& pooled = pool.validators[name];
+		pooled.schema = sd;
+		pooled.validator.reset(new SchemaValidator(*sd));
+		return pooled.validator.get();
+	}
+
+	static bool load_document(lua_State* L, int idx, Document& doc) {
+		switch (lua_type(L, idx)) {
+		case LUA_TSTRING: {
+			size_t len = 0;
+			const char* s = lua_tolstring(L, idx, &len);
+			doc.Parse(s, len);
+			if (doc.HasParseError()) {
+				lua_pushnil(L);
+				lua_pushfstring(L, "%s (at Offset %d)", GetParseError_En(doc.GetParseError()), (int)doc.GetErrorOffset());
+				return false;
+			}
+			return true;
+		}
+		case LUA_TTABLE:
+			values::toDocument(L, idx, &doc);
+			return true;
+		case LUA_TUSERDATA:
+			doc.CopyFrom(*Userdata<Document>::check(L, idx), doc.GetAllocator());
+			return true;
+		default:
+			luax::typerror(L, idx, "string, table or rapidjson.Document");
+			return false;
+		}
+	}
+
+	/**
+	* json.schema.register([name,] schema)
+	* Without a name the schema is keyed by the hash of its JSON text.
+	* Returns the key, or nil and the parse error.
+	*/
+	static int schema_register(lua_State* L) {
+		int idx = lua_gettop(L) >= 2 ? 2 : 1;
+		Document doc;
+		if (!load_document(L, idx, doc))
+			return 2;
+
+		std::string name;
+		if (idx == 2)
+			name = luaL_checkstring(L, 1);
+		else {
+			StringBuffer sb;
+			Writer<StringBuffer> writer(sb);
+			doc.Accept(writer);
+			char key[32];
+			snprintf(key, sizeof(key), "#%016llx", (unsigned long long)std::hash<std::string>()(std::string(sb.GetString(), sb.GetSize())));
+			name = key;
+		}
+
+		SharedSchema sd(new SchemaDocument(doc));
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_registry[name] = sd;
+		}
+		_generation.fetch_add(1, std::memory_order_release);
+		lua_pushlstring(L, name.c_str(), name.size());
+		return 1;
+	}
+
+	static int schema_remove(lua_State* L) {
+		std::string name = luaL_checkstring(L, 1);
+		size_t n = 0;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			n = _registry.erase(name);
+		}
+		if (n > 0)
+			_generation.fetch_add(1, std::memory_order_release);
+		lua_pushboolean(L, n > 0);
+		return 1;
+	}
+
+	static int schema_exist(lua_State* L) {
+		std::string name = luaL_checkstring(L, 1);
+		lua_pushboolean(L, find(name) ? 1 : 0);
+		return 1;
+	}
+
+	/**
+	* json.schema.validate(name, value)
+	* value is a JSON string (validated while it is parsed, no document is
+	* built), a table or a rapidjson.Document.
+	*/
+	static int schema_validate(lua_State* L) {
+		std::string name = luaL_checkstring(L, 1);
+		SchemaValidator* validator = acquire(name);
+		if (!validator) {
+			lua_pushnil(L);
+			lua_pushfstring(L, "schema %s not found", name.c_str());
+			return 2;
+		}
+
+		bool ok;
+		switch (lua_type(L, 2)) {
+		case LUA_TSTRING: {
+			size_t len = 0;
+			const char* s = lua_tolstring(L, 2, &len);
+			Reader reader;
+			extend::StringStream ss(s, len);
+			ParseResult r = reader.Parse(ss, *validator);
+			ok = validator->IsValid();
+			if (!r && ok) {
+				validator->Reset();
+				lua_pushnil(L);
+				lua_pushfstring(L, "%s (%d)", GetParseError_En(r.Code()), (int)r.Offset());
+				return 2;
+			}
+			break;
+		}
+		case LUA_TTABLE: {
+			Document doc;
+			values::toDocument(L, 2, &doc);
+			ok = doc.Accept(*validator);
+			break;
+		}
+		case LUA_TUSERDATA:
+			ok = Userdata<Document>::check(L, 2)->Accept(*validator);
+			break;
+		default:
+			return luax::typerror(L, 2, "string, table or rapidjson.Document");
+		}
+
+		lua_pushboolean(L, ok);
+		int nr = 1;
+		if (!ok) {
+			pushValidator_error(L, validator);
+			nr = 2;
+		}
+		validator->Reset();
+		return nr;
+	}
+
+	int push_registry(lua_State* L) {
+		static const luaL_Reg reg[] = {
+			{ "register", schema_register },
+			{ "remove", schema_remove },
+			{ "exist", schema_exist },
+			{ "validate", schema_validate },
+			{ NULL, NULL }
+		};
+		lua_newtable(L);
+		luax::setfuncs(L, reg);
+		return 1;
+	}
+}
@@ -0,0 +1,15 @@
+#ifndef __LUA_RAPIDJSON_SCHEMA_HPP__
+#define __LUA_RAPIDJSON_SCHEMA_HPP__
+
+#include <lua.hpp>
+
+/**
+* Process-wide registry of compiled schema documents (json.schema).
+* A schema is compiled once and shared read-only by every job; each thread
+* keeps its own validator per schema, so validating compiles nothing.
+*/
+namespace schema {
+	int push_registry(lua_State* L);
+}
+
+#endif // __LUA_RAPIDJSON_SCHEMA_HPP__
@@ -0,0 +1,343 @@
+#include <cstdio>
+#include <lua.hpp>
+
+#include "include/reader.h"
+#include "include/error/en.h"
+
+#include "userdata.hpp"
+#include "values.hpp"
+#include "stream.hpp"
+
+using namespace rapidjson;
+
+static const int STREAM_CALLBACK_ERROR = -2;
+
+static inline bool isWhitespace(char c)
+{
+	return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+JsonStream::JsonStream(int callback, bool items, size_t max_size)
+	: callback_(callback), items_(items), max_size_(max_size), busy_(false)
+{
+	reset();
+}
+
+void JsonStream::reset()
+{
+	buffer_.clear();
+	error_.clear();
+	start_ = pos_ = offset_ = 0;
+	state_ = BETWEEN;
+	depth_ = 0;
+	in_string_ = escaped_ = false;
+}
+
+bool JsonStream::fail(const char* message)
+{
+	char text[256];
+	snprintf(text, sizeof(text), "%s (%zu)", message, offset_ + pos_);
+	error_ = text;
+	return false;
+}
+
+/**
+* Parses buffer_[start_, end) and calls the callback with the value.
+* Returns false on a parse error or when the callback raised an error,
+* in which case the error object is left on the stack.
+*/
+bool JsonStream::emit(lua_State* L, size_t end)
+{
+	int top = lua_gettop(L);
+	{
+		Reader reader;
+		values::ToLuaHandler handler(L);
+		extend::StringStream s(buffer_.data() + start_, end - start_);
+		ParseResult r = reader.Parse(s, handler);
+		if (!r) {
+			lua_settop(L, top);
+			char text[256];
+			snprintf(text, sizeof(text), "%s (%zu)", GetParseError_En(r.Code()), offset_ + start_ + r.Offset());
+			error_ = text;
+			return false;
+		}
+	}
+	start_ = end;
+
+	lua_rawgeti(L, LUA_REGISTRYINDEX, callback_); // [value, callback]
+	lua_insert(L, -2); // [callback, value]
+	busy_ = true;
+	int status = lua_pcall(L, 1, 0, 0);
+	busy_ = false;
+	return status == LUA_OK;
+}
+
+void JsonStream::compact()
+{
+	if (state_ == BETWEEN || state_ == ITEM_WAIT)
+		start_ = pos_;
+	if (start_ > 0) {
+		buffer_.erase(0, start_);
+		offset_ += start_;
+		pos_ -= start_;
+		start_ = 0;
+	}
+}
+
+bool JsonStream::scan(lua_State* L)
+{
+	const char* p = buffer_.data();
+	size_t size = buffer_.size();
+	while (pos_ < size) {
+		char c = p[pos_];
+		switch (state_) {
+		case BETWEEN:
+			if (isWhitespace(c)) {
+				pos_++;
+				break;
+			}
+			if (items_) {
+				if (c != '[')
+					return fail("array expected");
+				state_ = ITEM_WAIT;
+				depth_ = 0; // 0: '[' just seen, 1: ',' just seen
+				pos_++;
+				break;
+			}
+			start_ = pos_++;
+			in_string_ = escaped_ = false;
+			if (c == '{' || c == '[') {
+				state_ = CONTAINER;
+				depth_ = 1;
+			}
+			else if (c == '"')
+				state_ = STRING;
+			else if (c == '}' || c == ']' || c == ',' || c == ':')
+				return fail("unexpected character");
+			else
+				state_ = SCALAR;
+			break;
+		case CONTAINER:
+			pos_++;
+			if (in_string_) {
+				if (escaped_)
+					escaped_ = false;
+				else if (c == '\\')
+					escaped_ = true;
+				else if (c == '"')
+					in_string_ = false;
+			}
+			else if (c == '"')
+				in_string_ = true;
+			else if (c == '{' || c == '[')
+				depth_++;
+			else if ((c == '}' || c == ']') && --depth_ == 0) {
+				state_ = BETWEEN;
+				if (!emit(L, pos_))
+					return false;
+			}
+			break;
+		case STRING:
+			pos_++;
+			if (escaped_)
+				escaped_ = false;
+			else if (c == '\\')
+				escaped_ = true;
+			else if (c == '"') {
+				state_ = BETWEEN;
+				if (!emit(L, pos_))
+					return false;
+			}
+			break;
+		case SCALAR:
+			if (isWhitespace(c) || c == '{' || c == '[' || c == '"') {
+				state_ = BETWEEN;
+				if (!emit(L, pos_))
+					return false;
+				break;
+			}
+			pos_++;
+			break;
+		case ITEM_WAIT:
+			if (isWhitespace(c)) {
+				pos_++;
+				break;
+			}
+			if (c == ']' && depth_ == 0) {
+				state_ = BETWEEN;
+				pos_++;
+				break;
+			}
+			start_ = pos_;
+			state_ = ITEM;
+			depth_ = 0;
+			in_string_ = escaped_ = false;
+			break;
+		case ITEM:
+			if (in_string_) {
+				if (escaped_)
+					escaped_ = false;
+				else if (c == '\\')
+					escaped_ = true;
+				else if (c == '"')
+					in_string_ = false;
+			}
+			else if (c == '"')
+				in_string_ = true;
+			else if (c == '{' || c == '[')
+				depth_++;
+			else if (c == '}' || (c == ']' && depth_ > 0)) {
+				if (--depth_ < 0)
+					return fail("unexpected character");
+			}
+			else if (depth_ == 0 && (c == ',' || c == ']')) {
+				state_ = (c == ',') ? ITEM_WAIT : BETWEEN;
+				if (!emit(L, pos_))
+					return false;
+				depth_ = (c == ',') ? 1 : 0;
+			}
+			pos_++;
+			break;
+		}
+		if (state_ != BETWEEN && state_ != ITEM_WAIT && max_size_ > 0 && pos_ - start_ > max_size_)
+			return fail("value too large");
+	}
+	return true;
+}
+
+/**
+* Returns 0, -1 on a parse error (kept in error_ until reset) or
+* STREAM_CALLBACK_ERROR with the callback's error on the stack.
+*/
+int JsonStream::write(lua_State* L, const char* data, size_t len)
+{
+	if (!error_.empty())
+		return -1;
+
+	buffer_.append(data, len);
+	bool ok = scan(L);
+	compact();
+	if (ok)
+		return 0;
+	return error_.empty() ? STREAM_CALLBACK_ERROR : -1;
+}
+
+int JsonStream::finish(lua_State* L)
+{
+	if (!error_.empty())
+		return -1;
+
+	if (state_ == SCALAR) {
+		state_ = BETWEEN;
+		if (!emit(L, buffer_.size()))
+			return error_.empty() ? STREAM_CALLBACK_ERROR : -1;
+		pos_ = buffer_.size();
+	}
+	if (state_ != BETWEEN) {
+		fail("incomplete value");
+		return -1;
+	}
+	compact();
+	return 0;
+}
+
+
+template<>
+const char* const Userdata<JsonStream>::metatable()
+{
+	return "rapidjson.Stream";
+}
+
+template<>
+JsonStream* Userdata<JsonStream>::construct(lua_State * L)
+{
+	luaL_checktype(L, 1, LUA_TFUNCTION);
+	bool items = false;
+	int max_size = 0;
+	if (!lua_isnoneornil(L, 2)) {
+		luaL_checktype(L, 2, LUA_TTABLE);
+		items = luax::optboolfield(L, 2, "items", false);
+		max_size = luax::optintfield(L, 2, "max_size", 0);
+	}
+	lua_pushvalue(L, 1);
+	int callback = luaL_ref(L, LUA_REGISTRYINDEX);
+	return new JsonStream(callback, items, max_size > 0 ? static_cast<size_t>(max_size) : 0);
+}
+
+static JsonStream* checkIdle(lua_State* L)
+{
+	JsonStream* s = Userdata<JsonStream>::check(L, 1);
+	if (s->busy())
+		luaL_error(L, "stream is busy, called from its own callback");
+	return s;
+}
+
+static int pushResult(lua_State* L, JsonStream* s, int n)
+{
+	if (n == STREAM_CALLBACK_ERROR)
+		return lua_error(L);
+	if (n < 0) {
+		lua_pushnil(L);
+		lua_pushstring(L, s->error());
+		return 2;
+	}
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+static int Stream_write(lua_State* L)
+{
+	JsonStream* s = checkIdle(L);
+	size_t len = 0;
+	const char* data = luaL_checklstring(L, 2, &len);
+	lua_settop(L, 2);
+	return pushResult(L, s, s->write(L, data, len));
+}
+
+static int Stream_finish(lua_State* L)
+{
+	JsonStream* s = checkIdle(L);
+	lua_settop(L, 1);
+	return pushResult(L, s, s->finish(L));
+}
+
+static int Stream_reset(lua_State* L)
+{
+	JsonStream* s = checkIdle(L);
+	s->reset();
+	return 0;
+}
+
+static int Stream_pending(lua_State* L)
+{
+	JsonStream* s = Userdata<JsonStream>::check(L, 1);
+	lua_pushinteger(L, static_cast<lua_Integer>(s->pending()));
+	return 1;
+}
+
+static int Stream_gc(lua_State* L)
+{
+	JsonStream** ud = Userdata<JsonStream>::getUserdata(L, 1);
+	if (*ud) {
+		luaL_unref(L, LUA_REGISTRYINDEX, (*ud)->callback());
+		delete *ud;
+		*ud = NULL;
+	}
+	return 0;
+}
+
+template <>
+const luaL_Reg* Userdata<JsonStream>::methods() {
+	static const luaL_Reg reg[] = {
+		{ "__gc", Stream_gc },
+		{ "__tostring", metamethod_tostring },
+
+		{ "write", Stream_write },
+		{ "finish", Stream_finish },
+		{ "reset", Stream_reset },
+		{ "pending", Stream_pending },
+
+		{ NULL, NULL }
+	};
+	return reg;
+}
@@ -0,0 +1,69 @@
+#ifndef __LUA_RAPIDJSON_STREAM_HPP__
+#define __LUA_RAPIDJSON_STREAM_HPP__
+
+#include <string>
+#include <lua.hpp>
+
+/**
+* Incremental parser behind json.stream(callback [, options]).
+*
+* Chunks are appended with write(); a light scanner finds where each value
+* ends, and the finished slice is parsed with the rapidjson SAX reader and
+* handed to the callback. Only the value being received is buffered.
+*
+* By default every top-level value is emitted (NDJSON or concatenated JSON);
+* with `items` the elements of top-level arrays are emitted one by one.
+*/
+class JsonStream {
+public:
+	JsonStream(int callback, bool items, size_t max_size);
+
+	int write(lua_State* L, const char* data, size_t len);
+	int finish(lua_State* L);
+	void reset();
+
+	inline size_t pending() const {
+		return buffer_.size() - start_;
+	}
+	inline int callback() const {
+		return callback_;
+	}
+	inline bool busy() const {
+		return busy_;
+	}
+	inline const char* error() const {
+		return error_.c_str();
+	}
+
+private:
+	enum State {
+		BETWEEN,    // waiting for a value (or for '[' with items)
+		CONTAINER,  // inside an object/array value
+		STRING,     // inside a top-level string
+		SCALAR,     // number, true, false or null
+		ITEM_WAIT,  // inside a top-level array, waiting for an element
+		ITEM,       // inside an element of a top-level array
+	};
+
+	bool scan(lua_State* L);
+	bool emit(lua_State* L, size_t end);
+	bool fail(const char* message);
+	void compact();
+
+	int callback_;
+	bool items_;
+	size_t max_size_;
+
+	std::string buffer_;
+	size_t start_;    // first byte of the value being received
+	size_t pos_;      // next byte to scan
+	size_t offset_;   // bytes dropped from the front of buffer_
+	State state_;
+	int depth_;
+	bool in_string_;
+	bool escaped_;
+	bool busy_;
+	std::string error_;
+};
+
+#endif // __LUA_RAPIDJSON_STREAM_HPP__
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "include/reader.h"
+
 namespace rapidjson
 {
     namespace extend
@@ -35,4 +37,12 @@ namespace rapidjson
     struct StreamTraits<extend::GenericStringStream<Encoding> > {
         enum { copyOptimization = 1 };
     };
+#ifdef RAPIDJSON_SIMD
+    // The buffer is not NUL-terminated, so only the bounded scan is safe here.
+    template<> inline void SkipWhitespace(extend::StringStream& is) {
+        const char* end = is.head_ + is.count_;
+        if (is.src_ < end)
+            is.src_ = SkipWhitespace_SIMD(is.src_, end);
+    }
+#endif // RAPIDJSON_SIMD
 }
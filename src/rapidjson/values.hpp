@@ -243,10 +243,9 @@ namespace values {
 
 
     template<typename Stream>
-    inline int pushDecoded(lua_State* L, Stream& s) {
+    inline int pushDecoded(lua_State* L, Stream& s, rapidjson::Reader& reader) {
         int top = lua_gettop(L);
         values::ToLuaHandler handler(L);
-        rapidjson::Reader reader;
         rapidjson::ParseResult r = reader.Parse(s, handler);
 
         if (!r) {
@@ -259,6 +258,12 @@ namespace values {
         return 1;
     }
 
+    template<typename Stream>
+    inline int pushDecoded(lua_State* L, Stream& s) {
+        rapidjson::Reader reader;
+        return pushDecoded(L, s, reader);
+    }
+
     inline int pushDecoded(lua_State* L, const char* ptr, size_t len) {
         rapidjson::extend::StringStream s(ptr, len);
         return pushDecoded(L, s);
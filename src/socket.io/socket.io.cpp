@@ -1,25 +1,31 @@
-
-
 /********************************************************************************/
 
 #include <eport.hpp>
-#include <map>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 #include "socket.io.hpp"
 
+#ifdef EPORT_SSL_ENABLE
+#include <openssl/evp.h>
+#endif
+
 using namespace eport;
 
 #define empty_context  io_context::value_type()
 #define empty_socket   ip::tcp::session()
 #define empty_timer    steady_timer::value_type()
 #define empty_acceptor ip::tcp::acceptor::value_type()
+#define empty_udp      ip::udp::socket::value_type()
 
 #define return_if_empty(what) if (!what) return lws_error;
 #define unique_mutex_lock(what) std::unique_lock<std::mutex> lock(what)
 
 /********************************************************************************/
 
-static std::mutex lws_mutex;
-
 class lws_local{
   const lws_int id;
 public:
@@ -28,56 +34,335 @@ public:
   inline lws_int state() const { return id; }
 };
 
-static std::map<
-  lws_int, io_context::value_type
-> lws_services_pool;
+/********************************************************************************/
+
+enum class lws_type : unsigned char {
+  none, service, socket, acceptor, timer, detached, udp, kcp, kcpacceptor
+};
+
+/* a socket taken out of its job by lws_detach, waiting for lws_adopt */
+struct lws_detached final {
+  ip::tcp::session socket;
+  ip::tcp::socket::parcel parcel;
+};
+
+/*
+ * Every handle given out by lws_* lives in one slot array indexed by id.
+ * A lookup reads the page directory without the shared mutex and only
+ * spins on the slot's own flag while it copies the pointer, so threads
+ * working on different handles never meet. The slot carries the handle
+ * type, the service that owns it and a generation bumped on every release.
+ * Each thread keeps its own lists of released and reusable slots; the
+ * shared queue is locked once per batch of releases, and by an insert
+ * only when a counter read without the lock says it has slots to reuse;
+ * fresh slots come from an atomic counter.
+ *
+ * An id is the slot index in the low 20 bits and the slot generation in
+ * the next 11, so it stays a positive 32-bit integer and an id kept after
+ * its handle was closed no longer matches the reused slot. Released slots
+ * queue up in release order and are only taken again once more than
+ * reuse_after others are waiting behind them, so one slot comes back with
+ * the same id only after millions of closes.
+ */
+class lws_handles final {
+  enum {
+    page_bits   = 12,
+    page_size   = 1 << page_bits,
+    index_bits  = 20,
+    max_index   = (1 << index_bits) - 1,
+    max_gen     = 0x7ff,
+    max_pages   = (max_index >> page_bits) + 1,
+    batch_size  = 64,
+    reuse_after = 4096,
+  };
+
+  struct slot {
+    std::atomic_flag busy;
+    lws_type  type  = lws_type::none;
+    lws_int   id    = 0;
+    lws_int   owner = 0;
+    unsigned  gen   = 0;
+    std::shared_ptr<void> ptr;
+    inline slot() { busy.clear(); }
+  };
+
+  class slot_lock final {
+    slot& _slot;
+  public:
+    inline slot_lock(slot& s) : _slot(s) {
+      for (int n = 0; _slot.busy.test_and_set(std::memory_order_acquire); n++) {
+        if (n > 64) std::this_thread::yield();
+      }
+    }
+    inline ~slot_lock() { _slot.busy.clear(std::memory_order_release); }
+  };
+
+  /* per thread batches, so the shared queue is locked once per batch_size;
+     ready holds the oldest released indices (the oldest at the back) and
+     released the ones this thread freed since its last spill */
+  struct local_cache final {
+    std::vector<unsigned> ready;
+    std::vector<unsigned> released;
+    inline ~local_cache() {
+      lws_handles::instance().giveback(ready);
+      lws_handles::instance().spill(released);
+      exited() = true;
+    }
+  };
+
+  std::mutex             _mutex;
+  std::atomic<unsigned>  _next;
+  std::deque<unsigned>   _unused;
+  std::atomic<size_t>    _queued; /* _unused.size(), read without the lock */
+  std::atomic<slot*>     _pages[max_pages];
 
-static std::map<
-  lws_int, ip::tcp::session
-> lws_sockets_pool;
+  lws_handles() : _next(1), _queued(0) {
+    for (auto& page : _pages) page.store(nullptr);
+  }
 
-static std::map<
-  lws_int, ip::tcp::acceptor::value_type
-> lws_acceptors_pool;
+  static local_cache& cache() {
+    static thread_local local_cache _cache;
+    return _cache;
+  }
 
-static std::map<
-  lws_int, steady_timer::value_type
-> lws_timers_pool;
+  /* set once the thread's cache is gone, later calls use the shared queue */
+  static bool& exited() {
+    static thread_local bool _exited = false;
+    return _exited;
+  }
+
+  static inline lws_int make_id(unsigned index, unsigned gen) {
+    return (lws_int)(((gen & max_gen) << index_bits) | index);
+  }
+
+  slot* at(lws_int id) const {
+    unsigned index = (unsigned)id & max_index;
+    if (id <= 0 || index == 0) {
+      return nullptr;
+    }
+    slot* page = _pages[index >> page_bits].load(std::memory_order_acquire);
+    return page ? &page[index & (page_size - 1)] : nullptr;
+  }
+
+  slot* page_slot(unsigned index) {
+    auto& page = _pages[index >> page_bits];
+    if (!page.load(std::memory_order_acquire)) {
+      unique_mutex_lock(_mutex);
+      if (!page.load(std::memory_order_relaxed)) {
+        page.store(new slot[page_size], std::memory_order_release);
+      }
+    }
+    return &page.load(std::memory_order_acquire)[index & (page_size - 1)];
+  }
+
+  /* called with the lock held after _unused changed */
+  inline void counted() {
+    _queued.store(_unused.size(), std::memory_order_relaxed);
+  }
+
+  inline bool reusable() const {
+    return _queued.load(std::memory_order_relaxed) > reuse_after;
+  }
+
+  /* the oldest released slot once enough are queued, else a fresh one,
+     and when no fresh ones are left any released slot at all */
+  unsigned pop_index() {
+    if (!exited()) {
+      auto& ready = cache().ready;
+      if (ready.empty() && reusable()) {
+        unique_mutex_lock(_mutex);
+        while (ready.size() < batch_size && _unused.size() > reuse_after) {
+          ready.push_back(_unused.front());
+          _unused.pop_front();
+        }
+        counted();
+        std::reverse(ready.begin(), ready.end());
+      }
+      if (!ready.empty()) {
+        unsigned index = ready.back();
+        ready.pop_back();
+        return index;
+      }
+    }
+    else if (reusable()) {
+      unique_mutex_lock(_mutex);
+      if (_unused.size() > reuse_after) {
+        unsigned index = _unused.front();
+        _unused.pop_front();
+        counted();
+        return index;
+      }
+    }
+    if (_next.load(std::memory_order_relaxed) <= max_index) {
+      unsigned index = _next.fetch_add(1);
+      if (index <= max_index) {
+        return index;
+      }
+    }
+    if (!exited()) {
+      spill(cache().released);
+    }
+    unique_mutex_lock(_mutex);
+    if (!_unused.empty()) {
+      unsigned index = _unused.front();
+      _unused.pop_front();
+      counted();
+      return index;
+    }
+    return 0;
+  }
+
+  void push_index(unsigned index) {
+    if (exited()) {
+      unique_mutex_lock(_mutex);
+      _unused.push_back(index);
+      counted();
+      return;
+    }
+    auto& released = cache().released;
+    released.push_back(index);
+    if (released.size() >= batch_size) {
+      spill(released);
+    }
+  }
+
+  /* released indices join the tail of the shared queue in release order */
+  void spill(std::vector<unsigned>& released) {
+    unique_mutex_lock(_mutex);
+    _unused.insert(_unused.end(), released.begin(), released.end());
+    counted();
+    released.clear();
+  }
+
+  /* unused ready indices are older than anything queued, they go in front */
+  void giveback(std::vector<unsigned>& ready) {
+    unique_mutex_lock(_mutex);
+    _unused.insert(_unused.begin(), ready.rbegin(), ready.rend());
+    counted();
+    ready.clear();
+  }
+
+public:
+  static lws_handles& instance() {
+    static lws_handles* _self = new lws_handles();
+    return *_self;
+  }
+
+  lws_int insert(lws_type type, lws_int owner, std::shared_ptr<void> ptr) {
+    if (!ptr) {
+      return lws_error;
+    }
+    unsigned index = pop_index();
+    if (index == 0) {
+      return lws_error;
+    }
+    slot* s = page_slot(index);
+    slot_lock lock(*s);
+    s->id    = make_id(index, s->gen);
+    s->type  = type;
+    s->owner = owner;
+    s->ptr   = std::move(ptr);
+    return s->id;
+  }
+
+  template <typename T>
+  std::shared_ptr<T> find(lws_int id, lws_type type) const {
+    slot* s = at(id);
+    if (!s) {
+      return std::shared_ptr<T>();
+    }
+    slot_lock lock(*s);
+    if (s->id != id || s->type != type) {
+      return std::shared_ptr<T>();
+    }
+    return std::static_pointer_cast<T>(s->ptr);
+  }
+
+  lws_type type(lws_int id) const {
+    slot* s = at(id);
+    if (!s) {
+      return lws_type::none;
+    }
+    slot_lock lock(*s);
+    return s->id == id ? s->type : lws_type::none;
+  }
+
+  lws_int owner(lws_int id) const {
+    slot* s = at(id);
+    if (!s) {
+      return lws_error;
+    }
+    slot_lock lock(*s);
+    if (s->id != id || s->type == lws_type::none || s->type == lws_type::service) {
+      return lws_error;
+    }
+    return s->owner;
+  }
+
+  /* takes the handle out, the caller closes it outside the slot lock */
+  std::shared_ptr<void> remove(lws_int id, lws_type& type) {
+    type = lws_type::none;
+    slot* s = at(id);
+    if (!s) {
+      return std::shared_ptr<void>();
+    }
+    std::shared_ptr<void> ptr;
+    {
+      slot_lock lock(*s);
+      if (s->id != id || s->type == lws_type::none) {
+        return ptr;
+      }
+      type = s->type;
+      ptr.swap(s->ptr);
+      s->type = lws_type::none;
+      s->id   = 0;
+      s->gen++;
+    }
+    push_index((unsigned)id & max_index);
+    return ptr;
+  }
+};
+
+static inline lws_handles& lws_pool() {
+  return lws_handles::instance();
+}
 
 static io_context::value_type find_service(lws_int id) {
-  unique_mutex_lock(lws_mutex);
-  auto iter = lws_services_pool.find(id);
-  return (iter == lws_services_pool.end() ? empty_context : iter->second);
+  return lws_pool().find<io_context::value_type::element_type>(id, lws_type::service);
 }
 
 static ip::tcp::session find_socket(lws_int id) {
-  unique_mutex_lock(lws_mutex);
-  auto iter = lws_sockets_pool.find(id);
-  return (iter == lws_sockets_pool.end() ? empty_socket : iter->second);
+  return lws_pool().find<ip::tcp::session::element_type>(id, lws_type::socket);
 }
 
 static ip::tcp::acceptor::value_type find_acceptor(lws_int id) {
-  unique_mutex_lock(lws_mutex);
-  auto iter = lws_acceptors_pool.find(id);
-  return (iter == lws_acceptors_pool.end() ? empty_acceptor : iter->second);
+  return lws_pool().find<ip::tcp::acceptor::value_type::element_type>(id, lws_type::acceptor);
+}
+
+static ip::udp::socket::value_type find_udp(lws_int id) {
+  return lws_pool().find<ip::udp::socket::value_type::element_type>(id, lws_type::udp);
 }
 
 static steady_timer::value_type find_timer(lws_int id) {
-  unique_mutex_lock(lws_mutex);
-  auto iter = lws_timers_pool.find(id);
-  return (iter == lws_timers_pool.end() ? empty_timer : iter->second);
+  return lws_pool().find<steady_timer::value_type::element_type>(id, lws_type::timer);
+}
+
+#ifdef EPORT_KCP_ENABLE
+static ip::kcp::socket::value_type find_kcp(lws_int id) {
+  return lws_pool().find<ip::kcp::socket::value_type::element_type>(id, lws_type::kcp);
 }
 
+static ip::kcp::acceptor::value_type find_kcpacceptor(lws_int id) {
+  return lws_pool().find<ip::kcp::acceptor::value_type::element_type>(id, lws_type::kcpacceptor);
+}
+#endif
+
 /********************************************************************************/
 
 LIB_CAPI lws_int lws_newstate() {
   auto state = io_context::create();
   return_if_empty(state);
-  auto id = state->id();
-
-  unique_mutex_lock(lws_mutex);
-  lws_services_pool[id] = state;
-  return id;
+  return lws_pool().insert(lws_type::service, 0, state);
 }
 
 LIB_CAPI lws_int lws_getlocal() {
@@ -86,66 +371,46 @@ LIB_CAPI lws_int lws_getlocal() {
 }
 
 LIB_CAPI lws_int lws_state(lws_int what) {
-  auto socket = find_socket(what);
-  if (socket) {
-    return socket->lowest_layer()->get_executor()->id();
-  }
-  auto timer = find_timer(what);
-  if (timer) {
-    return timer->get_executor()->id();
-  }
-  auto acceptor = find_acceptor(what);
-  return_if_empty(acceptor);
-  return acceptor->get_executor()->id();
+  return lws_pool().owner(what);
 }
 
 LIB_CAPI lws_int lws_close(lws_int what) {
-  auto socket = find_socket(what);
-  if (socket) {
-    socket->close();
-    unique_mutex_lock(lws_mutex);
-    lws_sockets_pool.erase(what);
-    return lws_true;
-  }
-  auto timer = find_timer(what);
-  if (timer) {
-    try { timer->cancel(); } catch (...) {}
-    unique_mutex_lock(lws_mutex);
-    lws_timers_pool.erase(what);
-    return lws_true;
-  }
-  auto state = find_service(what);
-  if (state) {
-    state->stop();
-    unique_mutex_lock(lws_mutex);
-    lws_services_pool.erase(what);
-    return lws_true;
-  }
-  auto acceptor = find_acceptor(what);
-  if (acceptor) {
-    acceptor->close();
-    unique_mutex_lock(lws_mutex);
-    lws_acceptors_pool.erase(what);
-    return lws_true;
+  lws_type type;
+  auto handle = lws_pool().remove(what, type);
+  switch (type) {
+  case lws_type::socket:
+    std::static_pointer_cast<ip::tcp::session::element_type>(handle)->close();
+    break;
+  case lws_type::timer:
+    try { std::static_pointer_cast<steady_timer::value_type::element_type>(handle)->cancel(); } catch (...) {}
+    break;
+  case lws_type::service:
+    std::static_pointer_cast<io_context::value_type::element_type>(handle)->stop();
+    break;
+  case lws_type::acceptor:
+    std::static_pointer_cast<ip::tcp::acceptor::value_type::element_type>(handle)->close();
+    break;
+  case lws_type::detached:
+    break; /*the parcel closes the descriptor*/
+  case lws_type::udp:
+    std::static_pointer_cast<ip::udp::socket::value_type::element_type>(handle)->close();
+    break;
+#ifdef EPORT_KCP_ENABLE
+  case lws_type::kcp:
+    std::static_pointer_cast<ip::kcp::socket::value_type::element_type>(handle)->close();
+    break;
+  case lws_type::kcpacceptor:
+    std::static_pointer_cast<ip::kcp::acceptor::value_type::element_type>(handle)->close();
+    break;
+#endif
+  default:
+    return lws_false;
   }
-  return lws_false;
+  return lws_true;
 }
 
 LIB_CAPI lws_int lws_valid(lws_int what) {
-  auto socket = find_socket(what);
-  if (socket) {
-    return lws_true;
-  }
-  auto timer = find_timer(what);
-  if (timer) {
-    return true;
-  }
-  auto state = find_service(what);
-  if (state) {
-    return true;
-  }
-  auto acceptor = find_acceptor(what);
-  return acceptor ? lws_true : lws_false;
+  return lws_pool().type(what) != lws_type::none ? lws_true : lws_false;
 }
 
 /********************************************************************************/
@@ -223,19 +488,65 @@ LIB_CAPI lws_int lws_pollone(lws_int st) {
 LIB_CAPI lws_int lws_resolve(lws_int st, const char* host, const char** addr) {
   auto state = find_service(st);
   return_if_empty(state);
+  return_if_empty(host);
 
   error_code ec;
-  asio::ip::tcp::resolver resolver(*state);
-  auto result = resolver.resolve(host, "0", ec);
+  auto list = ip::dns::instance().resolve(host, ec);
   if (ec) {
     return lws_false;
   }
   static thread_local std::string __local;
-  __local = result.begin()->endpoint().address().to_string();
+  __local = list.front().to_string();
   *addr = __local.c_str();
   return lws_true;
 }
 
+LIB_CAPI lws_int lws_asyncresolve(lws_int st, const char* host, lws_on_resolve f, lws_context ud) {
+  auto state = find_service(st);
+  return_if_empty(state);
+  return_if_empty(host);
+  return_if_empty(f);
+
+  ip::dns::instance().async_resolve(host, state,
+    [f, ud](const error_code& ec, const ip::dns::addresses& list) {
+      std::vector<lws_endinfo> items(list.size());
+      for (size_t i = 0; i < list.size(); i++) {
+        auto addr = list[i].to_string();
+        items[i].family = list[i].is_v4() ? AF_INET : AF_INET6;
+        items[i].port   = 0;
+        snprintf(items[i].ip, sizeof(items[i].ip), "%s", addr.c_str());
+      }
+      /*netdb codes collide with errno values, failures are told apart as one*/
+      int value = ec ? EHOSTUNREACH : 0;
+      if (ec && ec.category() == asio::error::get_system_category()) {
+        value = ec.value();
+      }
+      pcall(f, value, items.data(), items.size(), ud);
+    }
+  );
+  return lws_true;
+}
+
+LIB_CAPI lws_int lws_dnscache(lws_size ttl, lws_size negative_ttl) {
+  ip::dns::instance().set_ttl(ttl, negative_ttl);
+  return lws_true;
+}
+
+/* what the event loops wait on, fixed when building */
+LIB_CAPI const char* lws_backend() {
+#if defined(ASIO_HAS_IO_URING_AS_DEFAULT)
+  return "io_uring";
+#elif defined(ASIO_HAS_IOCP)
+  return "iocp";
+#elif defined(ASIO_HAS_EPOLL)
+  return "epoll";
+#elif defined(ASIO_HAS_KQUEUE)
+  return "kqueue";
+#else
+  return "select";
+#endif
+}
+
 LIB_CAPI lws_int lws_wwwget(lws_int st, const char* url, lws_on_wwwget f, lws_context ud) {
   auto state = find_service(st);
   return_if_empty(state);
@@ -255,46 +566,137 @@ LIB_CAPI lws_int lws_wwwget(lws_int st, const char* url, lws_on_wwwget f, lws_co
 
 /********************************************************************************/
 
-static ssl::context::value_type newssl(const lws_cainfo* ca) {
+static ssl::context::value_type loadssl(const lws_cainfo* ca, const std::string& fingerprint) {
   auto sslca = ssl::context::create();
-  if (!ca || !ca->crt.data) {
+  if (!ca) {
     return sslca;
   }
+  if (ca->verify) {
+    sslca->use_host_check();
+  }
   if (ca->caf) {
     auto buf = buffer(ca->caf, ca->caf_size);
     sslca->load_verify_buffer(buf);
     sslca->set_verify_mode(SSL_VERIFY_PEER);
     return sslca;
   }
-  if (ca->crt.data) {
-    auto buf = buffer(ca->crt.data, ca->crt.size);
-    sslca->use_certificate_chain(buf);
+  if (ca->verify) {
+    sslca->use_default_verify();
+    return sslca;
+  }
+  if (!ca->crt.data) {
+    return sslca;
   }
+  auto buf = buffer(ca->crt.data, ca->crt.size);
+  sslca->use_certificate_chain(buf);
   if (ca->key.data) {
     auto buf = buffer(ca->key.data, ca->key.size);
     sslca->use_private_key(buf, ca->pwd);
   }
+  sslca->use_session_cache(fingerprint);
   return sslca;
 }
 
+/*
+ * Contexts are cached by the SHA-256 of the pem bytes and shared by
+ * every socket on every thread, so an accept loop doesn't parse the
+ * keys again for each peer, and the server session cache and ticket
+ * keys of a context outlive single connections. Contexts only held
+ * by the cache are dropped when it gets full.
+ */
+class lws_sslcache final {
+  enum { max_size = 64 };
+  std::mutex _mutex;
+  std::unordered_map<std::string, ssl::context::value_type> _contexts;
+
+  static std::string fingerprint(const lws_cainfo* ca) {
+    std::string digest;
+#ifdef EPORT_SSL_ENABLE
+    std::unique_ptr<EVP_MD_CTX, void(*)(EVP_MD_CTX*)> sha256(EVP_MD_CTX_new(), EVP_MD_CTX_free);
+    if (!sha256 || !EVP_DigestInit_ex(sha256.get(), EVP_sha256(), nullptr)) {
+      return digest;
+    }
+    auto update = [&sha256](const char* data, size_t size) {
+      uint64_t length = data ? (uint64_t)size : ~0ull;
+      EVP_DigestUpdate(sha256.get(), &length, sizeof(length));
+      if (data) {
+        EVP_DigestUpdate(sha256.get(), data, size);
+      }
+    };
+    if (ca) {
+      update(ca->caf, ca->caf_size);
+      update(ca->crt.data, ca->crt.size);
+      update(ca->key.data, ca->key.size);
+      update(ca->pwd, ca->pwd ? strlen(ca->pwd) : 0);
+      update(ca->verify ? "verify" : nullptr, 6);
+    }
+    unsigned char hash[EVP_MAX_MD_SIZE];
+    unsigned int size = 0;
+    if (EVP_DigestFinal_ex(sha256.get(), hash, &size)) {
+      digest.assign((const char*)hash, size);
+    }
+#endif
+    return digest;
+  }
+
+public:
+  ssl::context::value_type get(const lws_cainfo* ca) {
+    auto key = fingerprint(ca);
+    if (key.empty()) {
+      return loadssl(ca, key);
+    }
+    {
+      unique_mutex_lock(_mutex);
+      auto iter = _contexts.find(key);
+      if (iter != _contexts.end()) {
+        return iter->second;
+      }
+    }
+    /*parsed unlocked, if two threads race the first one is kept*/
+    auto sslca = loadssl(ca, key);
+    unique_mutex_lock(_mutex);
+    if (_contexts.size() >= max_size) {
+      for (auto iter = _contexts.begin(); iter != _contexts.end();) {
+        iter->second.use_count() == 1 ? iter = _contexts.erase(iter) : ++iter;
+      }
+      if (_contexts.size() >= max_size) {
+        return sslca;
+      }
+    }
+    return _contexts.emplace(key, sslca).first->second;
+  }
+};
+
+static ssl::context::value_type newssl(const lws_cainfo* ca) {
+  static lws_sslcache cache;
+  return cache.get(ca);
+}
+
 LIB_CAPI lws_int lws_acceptor(lws_int id) {
   auto state = find_service(id);
   return_if_empty(state);
 
   auto acceptor = ip::tcp::acceptor::create(state);
   return_if_empty(acceptor);
-
-  unique_mutex_lock(lws_mutex);
-  lws_acceptors_pool[acceptor->id()] = acceptor;
-  return acceptor->id();
+  return lws_pool().insert(lws_type::acceptor, id, acceptor);
 }
 
 LIB_CAPI lws_int lws_listen(lws_int id, lws_ushort port, const char* host, int backlog) {
   if (!host) host = "::";
+  error_code ec;
+#ifdef EPORT_KCP_ENABLE
+  auto kcp = find_kcpacceptor(id);
+  if (kcp) {
+    auto address = ip::make_address(host, ec);
+    if (!ec) {
+      kcp->listen(ip::udp::endpoint(address, port), ec);
+    }
+    return ec ? (0 - ec.value()) : lws_true;
+  }
+#endif
   auto acceptor = find_acceptor(id);
   return_if_empty(acceptor);
 
-  error_code ec;
   ip::tcp::endpoint local;
   local.address(ip::make_address(host));
   local.port(port);
@@ -302,6 +704,13 @@ LIB_CAPI lws_int lws_listen(lws_int id, lws_ushort port, const char* host, int b
   return ec ? (0 - ec.value()) : lws_true;
 }
 
+LIB_CAPI lws_int lws_reuseport(lws_int id, lws_bool on) {
+  auto acceptor = find_acceptor(id);
+  return_if_empty(acceptor);
+  acceptor->reuse_port(on != lws_false);
+  return lws_true;
+}
+
 LIB_CAPI lws_int lws_accept(lws_int id, lws_int peer, lws_on_accept f, lws_context ud) {
   auto acceptor = find_acceptor(id);
   return_if_empty(acceptor);
@@ -314,10 +723,96 @@ LIB_CAPI lws_int lws_accept(lws_int id, lws_int peer, lws_on_accept f, lws_conte
     return ec ? (0 - ec.value()) : lws_true;
   }
   acceptor->async_accept(socket, 
-    [f, ud](const error_code& ec, ip::tcp::session peer) {
-      pcall(f, ec.value(), peer->id(), ud);
+    [f, ud, peer](const error_code& ec, ip::tcp::session) {
+      pcall(f, ec.value(), peer, ud);
+      if (ec) {
+        lws_close(peer);
+      }
+    }
+  );
+  return lws_true;
+}
+
+/* peers accepted by lws_acceptbatch, flushed at the end of the loop turn */
+struct lws_accepted final : std::enable_shared_from_this<lws_accepted> {
+  std::vector<lws_int> peers;
+  bool posted = false;
+
+  inline void push(lws_int sid, io_context::value_type executor, lws_on_accepts f, lws_context ud) {
+    peers.push_back(sid);
+    if (posted) {
+      return;
+    }
+    posted = true;
+    auto self = shared_from_this();
+    executor->post([self, f, ud]() {
+      if (self->posted) {
+        self->flush(f, ud);
+      }
+    });
+  }
+
+  inline void flush(lws_on_accepts f, lws_context ud) {
+    posted = false;
+    if (peers.empty()) {
+      return;
+    }
+    pcall(f, 0, peers.data(), peers.size(), ud);
+    peers.clear();
+  }
+};
+
+LIB_CAPI lws_int lws_acceptbatch(lws_int id, lws_int proto, lws_size max_batch, lws_on_accepts f, lws_context ud) {
+  return_if_empty(f);
+  lws_int st = lws_pool().owner(id);
+  auto accepted = std::make_shared<lws_accepted>();
+#ifdef EPORT_KCP_ENABLE
+  auto kcp = find_kcpacceptor(id);
+  if (kcp) {
+    auto prototype = find_kcp(proto);
+    return_if_empty(prototype);
+    auto executor = kcp->get_executor();
+    kcp->async_accept(prototype->get_options(),
+      [f, ud, st, accepted, executor](const error_code& ec, ip::kcp::socket::value_type peer) {
+        if (!peer) {
+          accepted->flush(f, ud);
+          pcall(f, ec.value(), nullptr, 0, ud);
+          return;
+        }
+        lws_int sid = lws_pool().insert(lws_type::kcp, st, peer);
+        if (sid > 0) {
+          accepted->push(sid, executor, f, ud);
+        }
+      }
+    );
+    return lws_true;
+  }
+#endif
+  auto acceptor = find_acceptor(id);
+  return_if_empty(acceptor);
+  auto socket = find_socket(proto);
+  return_if_empty(socket);
+  auto executor = acceptor->get_executor();
+  acceptor->async_accept_batch(
+    [socket]() { return socket->fork(); }, max_batch, INFLATE_F,
+    [f, ud, st, accepted, executor](const error_code& ec, ip::tcp::session peer) {
+      if (!peer) {
+        accepted->flush(f, ud);
+        pcall(f, ec.value(), nullptr, 0, ud);
+        return;
+      }
+      lws_int sid = lws_pool().insert(lws_type::socket, st, peer);
+      /*a failed handshake comes alone and is closed after the call*/
       if (ec) {
-        lws_close(peer->id());
+        if (sid > 0) {
+          accepted->flush(f, ud);
+          pcall(f, ec.value(), &sid, 1, ud);
+          lws_close(sid);
+        }
+        return;
+      }
+      if (sid > 0) {
+        accepted->push(sid, executor, f, ud);
       }
     }
   );
@@ -390,7 +885,6 @@ LIB_CAPI lws_int lws_socket(lws_int id, lws_family family, const lws_cainfo* cer
   auto state = find_service(id);
   return_if_empty(state);
 
-  lws_int sid = 0;
   ip::tcp::session socket;
   switch (family) {
   case lws_family::tcp:
@@ -405,13 +899,50 @@ LIB_CAPI lws_int lws_socket(lws_int id, lws_family family, const lws_cainfo* cer
   case lws_family::wss:
     socket = ip::tcp::stream::create(state, newssl(cert), true);
     break;
+  case lws_family::kcp:
+#ifdef EPORT_KCP_ENABLE
+    return lws_pool().insert(lws_type::kcp, id, ip::kcp::socket::create(state));
+#else
+    return (0 - error::operation_not_supported);
+#endif
   default: break;
   }
-  unique_mutex_lock(lws_mutex);
-  if (socket) {
-    lws_sockets_pool[socket->id()] = socket;
+  return lws_pool().insert(lws_type::socket, id, socket);
+}
+
+LIB_CAPI lws_int lws_detach(lws_int id) {
+  auto socket = find_socket(id);
+  return_if_empty(socket);
+
+  error_code ec;
+  auto detached = std::make_shared<lws_detached>();
+  socket->detach(detached->parcel, ec);
+  if (ec) {
+    return 0 - ec.value();
+  }
+  lws_type type;
+  lws_pool().remove(id, type);
+  detached->socket = socket;
+  return lws_pool().insert(lws_type::detached, 0, detached);
+}
+
+LIB_CAPI lws_int lws_adopt(lws_int st, lws_int token) {
+  auto state = find_service(st);
+  return_if_empty(state);
+  auto detached = lws_pool().find<lws_detached>(token, lws_type::detached);
+  return_if_empty(detached);
+
+  /*only one job gets it when several adopt the same token*/
+  lws_type type;
+  if (lws_pool().remove(token, type) != detached) {
+    return lws_error;
   }
-  return socket ? socket->id() : lws_error;
+  error_code ec;
+  detached->socket->attach(state, detached->parcel, ec);
+  if (ec) {
+    return 0 - ec.value();
+  }
+  return lws_pool().insert(lws_type::socket, st, detached->socket);
 }
 
 LIB_CAPI lws_int lws_timer(lws_int id) {
@@ -419,11 +950,7 @@ LIB_CAPI lws_int lws_timer(lws_int id) {
   return_if_empty(state);
   auto timer = steady_timer::create(state);
   return_if_empty(timer);
-  
-  unique_mutex_lock(lws_mutex);
-  static lws_int tnext = MAX_IDENTIFIER + 1;
-  lws_timers_pool[tnext] = timer;
-  return tnext++;
+  return lws_pool().insert(lws_type::timer, id, timer);
 }
 
 LIB_CAPI lws_int lws_expires(lws_int id, lws_size ms, lws_on_timer f, lws_context ud) {
@@ -446,6 +973,30 @@ LIB_CAPI lws_int lws_cancel(lws_int id) {
 }
 
 LIB_CAPI lws_int lws_connect(lws_int id, const char* host, lws_ushort port, lws_on_connect f, lws_context ud) {
+#ifdef EPORT_KCP_ENABLE
+  auto kcp = find_kcp(id);
+  if (kcp) {
+    /*kcp has no handshake, f only hears how resolving went*/
+    if (f == NULL) {
+      error_code ec;
+      auto list = ip::dns::instance().resolve(host, ec);
+      if (!ec) {
+        kcp->connect(ip::udp::endpoint(ip::dns::pick(list), port), ec);
+      }
+      return ec ? (0 - ec.value()) : lws_true;
+    }
+    ip::dns::instance().async_resolve(host, kcp->get_executor(),
+      [kcp, port, f, ud](const error_code& ec, const ip::dns::addresses& list) {
+        error_code result = ec;
+        if (!result) {
+          kcp->connect(ip::udp::endpoint(ip::dns::pick(list), port), result);
+        }
+        pcall(f, result.value(), ud);
+      }
+    );
+    return lws_true;
+  }
+#endif
   auto socket = find_socket(id);
   return_if_empty(socket);
 
@@ -470,16 +1021,32 @@ LIB_CAPI lws_int lws_write(lws_int id, const char* data, lws_size size) {
   return ec ? (0 - ec.value()) : (lws_int)bytes;
 }
 
-LIB_CAPI lws_int lws_send(lws_int id, const char* data, lws_size size, lws_on_send f, lws_context ud) {
-  auto socket = find_socket(id);
-  return_if_empty(socket);
+static lws_int send_packet(lws_int id, const char* data, lws_size size, std::shared_ptr<const void> hold, lws_on_send f, lws_context ud) {
   if (f == NULL) {
     f = [](lws_int, lws_size, lws_context) {};
   }
-  std::string packet(data, size);
-  auto state = socket->lowest_layer()->get_executor();
-  state->post([=]() {
-    socket->async_send(packet, 
+#ifdef EPORT_KCP_ENABLE
+  auto kcp = find_kcp(id);
+  if (kcp) {
+    /*the tunnel copies the message at once*/
+    if (!kcp->async_send(data, size)) {
+      return lws_false;
+    }
+    kcp->get_executor()->post([f, ud, size]() {
+      pcall(f, 0, size, ud);
+    });
+    return lws_true;
+  }
+#endif
+  auto socket = find_socket(id);
+  return_if_empty(socket);
+  /*inline on the socket's own thread, so pending() counts it at once*/
+  auto lowest = socket->lowest_layer();
+  auto state = lowest->get_executor();
+  lowest->posting(true);
+  state->dispatch([=]() {
+    lowest->posting(false);
+    socket->async_send(data, size, hold,
       [f, ud](const error_code& ec, lws_size trans) {
         pcall(f, ec.value(), trans, ud);
       }
@@ -488,6 +1055,147 @@ LIB_CAPI lws_int lws_send(lws_int id, const char* data, lws_size size, lws_on_se
   return lws_true;
 }
 
+LIB_CAPI lws_int lws_send(lws_int id, const char* data, lws_size size, lws_on_send f, lws_context ud) {
+  return_if_empty(data);
+  auto packet = std::make_shared<const std::string>(data, size);
+  return send_packet(id, packet->c_str(), size, packet, f, ud);
+}
+
+/* data is not copied, the caller keeps it alive until f is called */
+LIB_CAPI lws_int lws_sendref(lws_int id, const char* data, lws_size size, lws_on_send f, lws_context ud) {
+  return_if_empty(data);
+  return_if_empty(f);
+  std::shared_ptr<const void> hold(data, [](const void*) {});
+  return send_packet(id, data, size, hold, f, ud);
+}
+
+/*
+ * The message is copied and framed once for all the sockets, each owner
+ * thread gets one post with its share of them. Sockets above their high
+ * watermark are skipped, ids that are no longer sockets are taken out of
+ * the list and count is set to the ones left.
+ */
+LIB_CAPI lws_int lws_broadcast(lws_int* ids, lws_size* count, const char* data, lws_size size) {
+  return_if_empty(ids);
+  return_if_empty(count);
+  return_if_empty(data);
+
+  typedef std::vector<ip::tcp::session> members_type;
+  std::vector<std::pair<io_context::value_type, members_type>> batches;
+  lws_size live = 0;
+  for (lws_size i = 0; i < *count; i++) {
+    auto socket = find_socket(ids[i]);
+    if (!socket) {
+      continue;
+    }
+    ids[live++] = ids[i];
+    auto lowest = socket->lowest_layer();
+    auto state  = lowest->get_executor();
+    auto iter = batches.begin();
+    while (iter != batches.end() && iter->first != state) {
+      ++iter;
+    }
+    if (iter == batches.end()) {
+      batches.emplace_back(state, members_type());
+      iter = batches.end() - 1;
+    }
+    lowest->posting(true);
+    iter->second.push_back(socket);
+  }
+  *count = live;
+  if (batches.empty()) {
+    return lws_true;
+  }
+
+  auto message = io::ws::shared_message::create(data, size);
+  for (auto& batch : batches) {
+    auto members = std::make_shared<members_type>(std::move(batch.second));
+    batch.first->dispatch([members, message]() {
+      for (auto& socket : *members) {
+        socket->lowest_layer()->posting(false);
+        socket->async_send(message, [](const error_code&, size_t) {});
+      }
+    });
+  }
+  return lws_true;
+}
+
+LIB_CAPI lws_int lws_pending(lws_int id, lws_size* bytes) {
+  return_if_empty(bytes);
+  auto udp = find_udp(id);
+  if (udp) {
+    *bytes = udp->pending();
+    return lws_true;
+  }
+#ifdef EPORT_KCP_ENABLE
+  auto kcp = find_kcp(id);
+  if (kcp) {
+    *bytes = kcp->pending();
+    return lws_true;
+  }
+#endif
+  auto socket = find_socket(id);
+  return_if_empty(socket);
+  *bytes = socket->lowest_layer()->pending();
+  return lws_true;
+}
+
+LIB_CAPI lws_int lws_watermark(lws_int id, lws_size high, lws_size low) {
+  auto udp = find_udp(id);
+  if (udp) {
+    udp->watermark(high);
+    return lws_true;
+  }
+  auto socket = find_socket(id);
+  return_if_empty(socket);
+  auto lowest = socket->lowest_layer();
+  lowest->get_executor()->dispatch([lowest, high, low]() {
+    lowest->watermark(high, low);
+  });
+  return lws_true;
+}
+
+LIB_CAPI lws_int lws_ondrain(lws_int id, lws_on_drain f, lws_context ud) {
+  auto socket = find_socket(id);
+  return_if_empty(socket);
+  auto lowest = socket->lowest_layer();
+  lowest->get_executor()->dispatch([lowest, f, ud]() {
+    if (f == NULL) {
+      lowest->set_drain(nullptr);
+      return;
+    }
+    lowest->set_drain([f, ud]() { pcall(f, ud); });
+  });
+  return lws_true;
+}
+
+LIB_CAPI lws_int lws_setframing(lws_int id, lws_framing type, lws_size max_size) {
+  auto socket = find_socket(id);
+  return_if_empty(socket);
+  io::framing_type what = io::framing_type::none;
+  switch (type) {
+  case lws_framing::u16be:   what = io::framing_type::u16be;   break;
+  case lws_framing::u32le:   what = io::framing_type::u32le;   break;
+  case lws_framing::line:    what = io::framing_type::line;    break;
+  case lws_framing::msgpack: what = io::framing_type::msgpack; break;
+  default: break;
+  }
+  return socket->set_framing(what, max_size) ? lws_true : lws_false;
+}
+
+LIB_CAPI lws_int lws_setdeflate(lws_int id, const lws_deflate* opt) {
+  auto socket = find_socket(id);
+  return_if_empty(socket);
+  return_if_empty(opt);
+  io::ws::deflate_options options;
+  options.enable      = opt->enable != lws_false;
+  options.takeover    = opt->takeover != lws_false;
+  options.window_bits = opt->window_bits;
+  options.mem_level   = opt->mem_level;
+  options.min_size    = opt->min_size;
+  return socket->set_deflate(options) ? lws_true : lws_false;
+}
+
 LIB_CAPI lws_int lws_read(lws_int id, lws_on_receive f, lws_context ud) {
   auto socket = find_socket(id);
   return_if_empty(socket);
@@ -504,9 +1212,23 @@ LIB_CAPI lws_int lws_read(lws_int id, lws_on_receive f, lws_context ud) {
 }
 
 LIB_CAPI lws_int lws_receive(lws_int id, lws_on_receive f, lws_context ud) {
+  return_if_empty(f);
+#ifdef EPORT_KCP_ENABLE
+  auto kcp = find_kcp(id);
+  if (kcp) {
+    kcp->async_receive(
+      [f, ud, id](const error_code& ec, const char* data, lws_size size) {
+        pcall(f, ec.value(), data, size, ud);
+        if (ec) {
+          lws_close(id);
+        }
+      }
+    );
+    return lws_true;
+  }
+#endif
   auto socket = find_socket(id);
   return_if_empty(socket);
-  return_if_empty(f);
 
   socket->async_receive(
     [f, ud, id](const error_code& ec, const char* data, lws_size size) {
@@ -525,6 +1247,75 @@ LIB_CAPI lws_int lws_receive(lws_int id, lws_on_receive f, lws_context ud) {
   return lws_true;
 }
 
+/* messages gathered by lws_recvbatch, flushed at the end of the loop turn */
+struct lws_batch final {
+  std::string data;
+  std::vector<lws_size> sizes;
+  std::vector<lws_slice> items;
+  bool posted = false;
+
+  inline void push(const char* pdata, lws_size size) {
+    data.append(pdata, size);
+    sizes.push_back(size);
+  }
+
+  inline void flush(lws_on_batch f, lws_context ud) {
+    posted = false;
+    if (sizes.empty()) {
+      return;
+    }
+    const char* pdata = data.c_str();
+    for (auto size : sizes) {
+      items.push_back({ pdata, size });
+      pdata += size;
+    }
+    pcall(f, 0, items.data(), items.size(), ud);
+    items.clear();
+    sizes.clear();
+    data.clear();
+  }
+};
+
+LIB_CAPI lws_int lws_recvbatch(lws_int id, lws_size max_count, lws_on_batch f, lws_context ud) {
+  auto socket = find_socket(id);
+  return_if_empty(socket);
+  return_if_empty(f);
+
+  if (max_count == 0) {
+    max_count = 1;
+  }
+  auto batch = std::make_shared<lws_batch>();
+  auto executor = socket->lowest_layer()->get_executor();
+
+  socket->async_receive(
+    [f, ud, id, max_count, batch, executor](const error_code& ec, const char* data, lws_size size) {
+      if (ec) {
+        batch->flush(f, ud);
+        std::string err = error_message(ec);
+        lws_slice item = { err.c_str(), err.size() };
+        pcall(f, ec.value(), &item, 1, ud);
+        lws_close(id);
+        return;
+      }
+      batch->push(data, size);
+      if (batch->sizes.size() >= max_count) {
+        batch->flush(f, ud);
+        return;
+      }
+      /* the rest of this read is decoded before the posted flush runs */
+      if (!batch->posted) {
+        batch->posted = true;
+        executor->post([f, ud, batch]() {
+          if (batch->posted) {
+            batch->flush(f, ud);
+          }
+        });
+      }
+    }
+  );
+  return lws_true;
+}
+
 LIB_CAPI lws_int lws_endpoint(lws_int id, lws_endinfo* inf, lws_endtype type) {
   error_code ec;
   if (inf == NULL) {
@@ -544,6 +1335,45 @@ LIB_CAPI lws_int lws_endpoint(lws_int id, lws_endinfo* inf, lws_endtype type) {
     strcpy(inf->ip, addr.c_str());
     return lws_true;
   }
+#ifdef EPORT_KCP_ENABLE
+  auto kcp = find_kcp(id);
+  ip::kcp::acceptor::value_type kcpacceptor;
+  if (!kcp) {
+    kcpacceptor = find_kcpacceptor(id);
+  }
+  if (kcp || kcpacceptor) {
+    ip::udp::endpoint where;
+    if (kcpacceptor) {
+      if (type != lws_endtype::local) {
+        return lws_error;
+      }
+      where = kcpacceptor->local_endpoint(ec);
+    }
+    else {
+      where = (type == lws_endtype::local ? kcp->local_endpoint(ec) : kcp->remote_endpoint(ec));
+    }
+    if (ec) {
+      return (0 - ec.value());
+    }
+    inf->port   = where.port();
+    inf->family = where.protocol().family();
+    auto addr = where.address().to_string();
+    strcpy(inf->ip, addr.c_str());
+    return lws_true;
+  }
+#endif
+  auto udp = find_udp(id);
+  if (udp) {
+    auto where = (type == lws_endtype::local ? udp->local_endpoint(ec) : udp->remote_endpoint(ec));
+    if (ec) {
+      return (0 - ec.value());
+    }
+    inf->port   = where.port();
+    inf->family = where.protocol().family();
+    auto addr = where.address().to_string();
+    strcpy(inf->ip, addr.c_str());
+    return lws_true;
+  }
   auto acceptor = find_acceptor(id);
   return_if_empty(acceptor);
   if (type != lws_endtype::local) {
@@ -561,3 +1391,180 @@ LIB_CAPI lws_int lws_endpoint(lws_int id, lws_endinfo* inf, lws_endtype type) {
 }
 
 /********************************************************************************/
+
+LIB_CAPI lws_int lws_udp(lws_int id, lws_size max_size) {
+  auto state = find_service(id);
+  return_if_empty(state);
+
+  auto socket = ip::udp::socket::create(state);
+  return_if_empty(socket);
+  socket->max_datagram(max_size ? max_size : 65536);
+  return lws_pool().insert(lws_type::udp, id, socket);
+}
+
+LIB_CAPI lws_int lws_udpbind(lws_int id, lws_ushort port, const char* host) {
+  if (!host) host = "0.0.0.0";
+  auto socket = find_udp(id);
+  return_if_empty(socket);
+
+  error_code ec;
+  auto address = ip::make_address(host, ec);
+  if (!ec) {
+    socket->bind(ip::udp::endpoint(address, port), ec);
+  }
+  return ec ? (0 - ec.value()) : lws_true;
+}
+
+static void udp_connect(const ip::udp::socket::value_type& socket, const ip::dns::addresses& list, lws_ushort port, error_code& ec) {
+  for (auto& addr : list) {
+    socket->connect(ip::udp::endpoint(addr, port), ec);
+    if (!ec) {
+      break;
+    }
+  }
+}
+
+/* without f the name is resolved on the calling thread */
+LIB_CAPI lws_int lws_udpconnect(lws_int id, const char* host, lws_ushort port, lws_on_connect f, lws_context ud) {
+  auto socket = find_udp(id);
+  return_if_empty(socket);
+  return_if_empty(host);
+
+  if (f == NULL) {
+    error_code ec;
+    auto list = ip::dns::instance().resolve(host, ec);
+    udp_connect(socket, list, port, ec);
+    return ec ? (0 - ec.value()) : lws_true;
+  }
+  ip::dns::instance().async_resolve(host, socket->get_executor(),
+    [socket, port, f, ud](const error_code& ec, const ip::dns::addresses& list) {
+      error_code result = ec;
+      if (!result) {
+        udp_connect(socket, list, port, result);
+      }
+      pcall(f, result.value(), ud);
+    }
+  );
+  return lws_true;
+}
+
+LIB_CAPI lws_int lws_udpbuffers(lws_int id, lws_size recv, lws_size send) {
+  auto socket = find_udp(id);
+  return_if_empty(socket);
+
+  error_code ec;
+  socket->buffers(recv, send, ec);
+  return ec ? (0 - ec.value()) : lws_true;
+}
+
+LIB_CAPI lws_int lws_sendto(lws_int id, const char* data, lws_size size, const char* addr, lws_ushort port) {
+  auto socket = find_udp(id);
+  return_if_empty(socket);
+  return_if_empty(data);
+
+  if (!addr) {
+    return socket->queue_send(data, size, nullptr) ? lws_true : lws_false;
+  }
+  error_code ec;
+  auto address = ip::make_address(addr, ec);
+  if (ec) {
+    return (0 - ec.value());
+  }
+  ip::udp::endpoint remote(address, port);
+  if (!socket->is_open()) {
+    socket->open(remote.protocol(), ec);
+  }
+  else if (address.is_v4() && socket->local_endpoint(ec).address().is_v6()) {
+    /*a socket bound to :: reaches ipv4 peers by their mapped address*/
+    remote.address(asio::ip::make_address_v6(asio::ip::v4_mapped, address.to_v4()));
+  }
+  if (ec) {
+    return (0 - ec.value());
+  }
+  return socket->queue_send(data, size, &remote) ? lws_true : lws_false;
+}
+
+static void udp_endinfo(const ip::udp::endpoint& remote, lws_endinfo& inf) {
+  error_code ec;
+  const void* addr;
+  unsigned long scope = 0;
+  if (remote.address().is_v4()) {
+    addr = &((const sockaddr_in*)remote.data())->sin_addr;
+  }
+  else {
+    addr  = &((const sockaddr_in6*)remote.data())->sin6_addr;
+    scope = ((const sockaddr_in6*)remote.data())->sin6_scope_id;
+  }
+  inf.family = remote.protocol().family();
+  inf.port   = remote.port();
+  if (!asio::detail::socket_ops::inet_ntop(inf.family, addr, inf.ip, sizeof(inf.ip), scope, ec)) {
+    inf.ip[0] = 0;
+  }
+}
+
+LIB_CAPI lws_int lws_udprecv(lws_int id, lws_size max_count, lws_on_datagram f, lws_context ud) {
+  auto socket = find_udp(id);
+  return_if_empty(socket);
+  return_if_empty(f);
+
+  auto items = std::make_shared<std::vector<lws_datagram>>();
+  socket->async_receive_batch(max_count,
+    [f, ud, items](const error_code& ec, const ip::udp::socket::datagram* data, size_t count) {
+      if (ec) {
+        pcall(f, ec.value(), nullptr, 0, ud);
+        return;
+      }
+      items->resize(count);
+      for (size_t i = 0; i < count; i++) {
+        auto& item = (*items)[i];
+        item.data = data[i].data;
+        item.size = data[i].size;
+        udp_endinfo(data[i].remote, item.from);
+      }
+      pcall(f, 0, items->data(), count, ud);
+    }
+  );
+  return lws_true;
+}
+
+/********************************************************************************/
+
+#ifdef EPORT_KCP_ENABLE
+LIB_CAPI lws_int lws_kcpacceptor(lws_int id) {
+  auto state = find_service(id);
+  return_if_empty(state);
+
+  auto acceptor = ip::kcp::acceptor::create(state);
+  return_if_empty(acceptor);
+  return lws_pool().insert(lws_type::kcpacceptor, id, acceptor);
+}
+
+/* an acceptor's peers take the options of the prototype given to lws_acceptbatch */
+LIB_CAPI lws_int lws_setkcp(lws_int id, const lws_kcp* opt) {
+  auto kcp = find_kcp(id);
+  return_if_empty(kcp);
+  return_if_empty(opt);
+  ip::kcp::options options;
+  options.snd_wnd  = opt->snd_wnd;
+  options.rcv_wnd  = opt->rcv_wnd;
+  options.mtu      = opt->mtu;
+  options.interval = opt->interval;
+  options.nodelay  = opt->nodelay;
+  options.resend   = opt->resend;
+  options.nc       = opt->nc;
+  kcp->get_executor()->dispatch([kcp, options]() {
+    kcp->set_options(options);
+  });
+  return lws_true;
+}
+#else
+LIB_CAPI lws_int lws_kcpacceptor(lws_int) {
+  return (0 - error::operation_not_supported);
+}
+
+LIB_CAPI lws_int lws_setkcp(lws_int, const lws_kcp*) {
+  return (0 - error::operation_not_supported);
+}
+#endif
+
+/********************************************************************************/
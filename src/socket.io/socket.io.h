@@ -29,6 +29,9 @@ typedef size_t          lws_size;
 #define lws_error       (-1)
 
 typedef const lws_void* lws_context;
+typedef struct lws_slice lws_slice;
+typedef struct lws_datagram lws_datagram;
+typedef struct lws_endinfo lws_endinfo;
 typedef lws_void (*lws_on_post)   (lws_context ud);
 typedef lws_void (*lws_on_connect)(lws_int ec, lws_context ud);
 typedef lws_void (*lws_on_send)   (lws_int ec, lws_size size, lws_context ud);
@@ -36,13 +39,22 @@ typedef lws_void (*lws_on_receive)(lws_int ec, const char* data, lws_size size,
 typedef lws_void (*lws_on_accept) (lws_int ec, lws_int peer, lws_context ud);
 typedef lws_void (*lws_on_timer)  (lws_int ec, lws_context ud);
 typedef lws_void (*lws_on_wwwget) (const char* data, lws_size size, lws_context ud);
+typedef lws_void (*lws_on_drain)  (lws_context ud);
+typedef lws_void (*lws_on_batch)  (lws_int ec, const lws_slice* items, lws_size count, lws_context ud);
+typedef lws_void (*lws_on_accepts)(lws_int ec, const lws_int* peers, lws_size count, lws_context ud);
+typedef lws_void (*lws_on_datagram)(lws_int ec, const lws_datagram* items, lws_size count, lws_context ud);
+typedef lws_void (*lws_on_resolve)(lws_int ec, const lws_endinfo* items, lws_size count, lws_context ud);
 
 /********************************************************************************/
 
 #pragma pack(push, 8)
 
 enum struct lws_family {
-  tcp, ssl, ws, wss
+  tcp, ssl, ws, wss, kcp
+};
+
+enum struct lws_framing {
+  none, u16be, u32le, line, msgpack
 };
 
 enum struct lws_endtype {
@@ -55,6 +67,35 @@ struct lws_endinfo {
   lws_ushort port;    /* host's byte order */
 };
 
+struct lws_deflate {
+  lws_bool enable;      /* offer or accept permessage-deflate */
+  lws_bool takeover;    /* keep the compression history between messages */
+  lws_int  window_bits; /* 9..15 */
+  lws_int  mem_level;   /* 1..9 */
+  lws_size min_size;    /* shorter messages are sent uncompressed */
+};
+
+struct lws_slice {
+  const char* data;   /* message data */
+  lws_size    size;   /* size of message */
+};
+
+struct lws_datagram {
+  const char* data;   /* datagram payload */
+  lws_size    size;   /* size of payload */
+  lws_endinfo from;   /* sender */
+};
+
+struct lws_kcp {
+  lws_int snd_wnd;    /* send window in packets */
+  lws_int rcv_wnd;    /* receive window in packets */
+  lws_int mtu;        /* largest datagram */
+  lws_int interval;   /* update interval in ms */
+  lws_int nodelay;    /* 0 or 1, as ikcp_nodelay */
+  lws_int resend;     /* fast resend after that many acks skipped, 0 disables */
+  lws_int nc;         /* 1 turns congestion control off */
+};
+
 struct lws_cainfo {
   struct {
     const char* data; /* certificate chain */
@@ -67,6 +108,7 @@ struct lws_cainfo {
   const char* pwd;    /* the password of private key */
   const char* caf;
   size_t      caf_size;
+  lws_bool    verify; /* clients check the server name, and without caf the system store */
 };
 
 #pragma pack(pop)
@@ -78,6 +120,9 @@ LIB_CAPI lws_int lws_state     (lws_int what);
 LIB_CAPI lws_int lws_close     (lws_int what);
 LIB_CAPI lws_int lws_valid     (lws_int what);
 LIB_CAPI lws_int lws_resolve   (lws_int st, const char* host, const char** addr);
+LIB_CAPI lws_int lws_asyncresolve(lws_int st, const char* host, lws_on_resolve f, lws_context ud);
+LIB_CAPI lws_int lws_dnscache  (lws_size ttl, lws_size negative_ttl);
+LIB_CAPI const char* lws_backend();
 LIB_CAPI lws_int lws_wwwget    (lws_int st, const char* url, lws_on_wwwget f, lws_context ud);
 LIB_CAPI lws_int lws_getlocal();
 
@@ -99,7 +144,9 @@ LIB_CAPI lws_int lws_pollone   (lws_int st);
 
 LIB_CAPI lws_int lws_acceptor  (lws_int st);
 LIB_CAPI lws_int lws_accept    (lws_int id, lws_int peer, lws_on_accept f, lws_context ud);
+LIB_CAPI lws_int lws_acceptbatch(lws_int id, lws_int proto, lws_size max_batch, lws_on_accepts f, lws_context ud);
 LIB_CAPI lws_int lws_listen    (lws_int id, lws_ushort port, const char* host, int backlog);
+LIB_CAPI lws_int lws_reuseport (lws_int id, lws_bool on);
 
 /********************************************************************************/
 
@@ -114,8 +161,32 @@ LIB_CAPI lws_int lws_connect   (lws_int id, const char* host, lws_ushort port, l
 LIB_CAPI lws_int lws_read      (lws_int id, lws_on_receive f, lws_context ud);
 LIB_CAPI lws_int lws_write     (lws_int id, const char* data, lws_size size);
 LIB_CAPI lws_int lws_receive   (lws_int id, lws_on_receive f, lws_context ud);
+LIB_CAPI lws_int lws_recvbatch (lws_int id, lws_size max_count, lws_on_batch f, lws_context ud);
 LIB_CAPI lws_int lws_send      (lws_int id, const char* data, lws_size size, lws_on_send f, lws_context ud);
+LIB_CAPI lws_int lws_sendref   (lws_int id, const char* data, lws_size size, lws_on_send f, lws_context ud);
+LIB_CAPI lws_int lws_broadcast (lws_int* ids, lws_size* count, const char* data, lws_size size);
 LIB_CAPI lws_int lws_endpoint  (lws_int id, lws_endinfo* inf, lws_endtype type);
+LIB_CAPI lws_int lws_pending   (lws_int id, lws_size* bytes);
+LIB_CAPI lws_int lws_watermark (lws_int id, lws_size high, lws_size low);
+LIB_CAPI lws_int lws_ondrain   (lws_int id, lws_on_drain f, lws_context ud);
+LIB_CAPI lws_int lws_setframing(lws_int id, lws_framing type, lws_size max_size);
+LIB_CAPI lws_int lws_detach    (lws_int id);
+LIB_CAPI lws_int lws_adopt     (lws_int st, lws_int token);
+LIB_CAPI lws_int lws_setdeflate(lws_int id, const lws_deflate* opt);
+
+/********************************************************************************/
+
+LIB_CAPI lws_int lws_udp       (lws_int st, lws_size max_size);
+LIB_CAPI lws_int lws_udpbind   (lws_int id, lws_ushort port, const char* host);
+LIB_CAPI lws_int lws_udpconnect(lws_int id, const char* host, lws_ushort port, lws_on_connect f, lws_context ud);
+LIB_CAPI lws_int lws_udpbuffers(lws_int id, lws_size recv, lws_size send);
+LIB_CAPI lws_int lws_udprecv   (lws_int id, lws_size max_count, lws_on_datagram f, lws_context ud);
+LIB_CAPI lws_int lws_sendto    (lws_int id, const char* data, lws_size size, const char* addr, lws_ushort port);
+
+/********************************************************************************/
+
+LIB_CAPI lws_int lws_kcpacceptor(lws_int st);
+LIB_CAPI lws_int lws_setkcp    (lws_int id, const lws_kcp* opt);
 
 /********************************************************************************/
 
@@ -13,6 +13,10 @@ typedef std::function<void(int ec, int peer)> accept_handler;
 typedef std::function<void(int ec)> connect_handler;
 typedef std::function<void(int ec, lws_size size)> send_handler;
 typedef std::function<void(int ec, const char* data, lws_size size)> receive_handler;
+typedef std::function<void(int ec, const lws_slice* items, lws_size count)> batch_handler;
+typedef std::function<void(int ec, const lws_int* peers, lws_size count)> accepts_handler;
+typedef std::function<void(int ec, const lws_datagram* items, lws_size count)> datagram_handler;
+typedef std::function<void(int ec, const lws_endinfo* items, lws_size count)> resolve_handler;
 typedef std::function<void(int ec)> timer_handler;
 typedef std::function<void(const char* data, lws_size size)> wwwget_handler;
 
@@ -166,6 +170,33 @@ inline lws_int resolve(lws_int st, const char* host, const char** addr) {
   return ::lws_resolve(st, host, addr);
 }
 
+/* void(int ec, const lws_endinfo* items, lws_size count), on this thread's loop */
+template <typename Handler>
+inline lws_int asyncresolve(const char* host, Handler&& handler) {
+  lws_int st = getlocal();
+  assert(st > 0);
+  assert(host);
+  static auto cb = [](lws_int ec, const lws_endinfo* items, lws_size count, lws_context ud) {
+    resolve_handler* f = (resolve_handler*)ud;
+    (*f)(ec, items, count);
+    delete f;
+  };
+  auto ud = new resolve_handler(handler);
+  lws_int ok = ::lws_asyncresolve(st, host, cb, ud);
+  if (ok != lws_true) {
+    delete ud;
+  }
+  return ok;
+}
+
+inline lws_int dnscache(lws_size ttl, lws_size negative_ttl) {
+  return ::lws_dnscache(ttl, negative_ttl);
+}
+
+inline const char* backend() {
+  return ::lws_backend();
+}
+
 inline lws_int acceptor() {
   lws_int st = getlocal();
   assert(st > 0);
@@ -177,6 +208,17 @@ inline lws_int acceptor(lws_int st) {
   return ::lws_acceptor(st);
 }
 
+inline lws_int kcpacceptor() {
+  lws_int st = getlocal();
+  assert(st > 0);
+  return ::lws_kcpacceptor(st);
+}
+
+inline lws_int kcpacceptor(lws_int st) {
+  assert(st > 0);
+  return ::lws_kcpacceptor(st);
+}
+
 inline lws_int socket(lws_family type, const lws_cainfo* ca = nullptr) {
   lws_int st = getlocal();
   assert(st > 0);
@@ -188,6 +230,68 @@ inline lws_int socket(lws_int st, lws_family type, const lws_cainfo* ca = nullpt
   return ::lws_socket(st, type, ca);
 }
 
+inline lws_int udp(lws_size max_size = 0) {
+  lws_int st = getlocal();
+  assert(st > 0);
+  return ::lws_udp(st, max_size);
+}
+
+inline lws_int udp(lws_int st, lws_size max_size) {
+  assert(st > 0);
+  return ::lws_udp(st, max_size);
+}
+
+inline lws_int udpbind(lws_int id, lws_ushort port, const char* host = nullptr) {
+  assert(id > 0);
+  return ::lws_udpbind(id, port, host);
+}
+
+inline lws_int udpconnect(lws_int id, const char* host, lws_ushort port) {
+  assert(id > 0);
+  assert(host);
+  return ::lws_udpconnect(id, host, port, nullptr, nullptr);
+}
+
+/* void(int ec) */
+template <typename Handler>
+inline lws_int udpconnect(lws_int id, const char* host, lws_ushort port, Handler&& handler) {
+  assert(id > 0);
+  assert(host);
+  static auto cb = [](lws_int ec, lws_context ud) {
+    connect_handler* f = (connect_handler*)ud;
+    (*f)(ec);
+    delete f;
+  };
+  auto ud = new connect_handler(handler);
+  return ::lws_udpconnect(id, host, port, cb, ud);
+}
+
+inline lws_int udpbuffers(lws_int id, lws_size recv, lws_size send = 0) {
+  assert(id > 0);
+  return ::lws_udpbuffers(id, recv, send);
+}
+
+/* addr is a numeric address, nullptr sends to the connected peer */
+inline lws_int sendto(lws_int id, const char* data, lws_size size, const char* addr = nullptr, lws_ushort port = 0) {
+  assert(id > 0);
+  return ::lws_sendto(id, data, size, addr, port);
+}
+
+/* void(int ec, const lws_datagram* items, lws_size count) */
+template <typename Handler>
+inline lws_int udprecv(lws_int id, lws_size max_count, Handler&& handler) {
+  assert(id > 0);
+  static auto cb = [](lws_int ec, const lws_datagram* items, lws_size count, lws_context ud) {
+    datagram_handler* f = (datagram_handler*)ud;
+    (*f)(ec, items, count);
+    if (ec) {
+      delete f;
+    }
+  };
+  auto ud = new datagram_handler(handler);
+  return ::lws_udprecv(id, max_count, cb, ud);
+}
+
 inline lws_int timer() {
   lws_int st = getlocal();
   assert(st > 0);
@@ -209,6 +313,11 @@ inline lws_int listen(lws_int id, lws_ushort port, const char* host = nullptr, i
   return ::lws_listen(id, port, host, backlog);
 }
 
+inline lws_int reuseport(lws_int id, bool on = true) {
+  assert(id > 0);
+  return ::lws_reuseport(id, on ? lws_true : lws_false);
+}
+
 inline lws_int setudata(lws_int id, lws_context ud) {
   assert(id > 0);
   return ::lws_setudata(id, ud);
@@ -341,6 +450,23 @@ inline lws_int accept(lws_int id, lws_int peer, Handler&& handler) {
   return ::lws_accept(id, peer, cb, ud);
 }
 
+/* void(int ec, const lws_int* peers, lws_size count), proto is copied for every peer,
+   a failed handshake comes alone with ec set, the last call has ec set and no peers */
+template <typename Handler>
+inline lws_int acceptbatch(lws_int id, lws_int proto, lws_size max_batch, Handler&& handler) {
+  assert(id > 0);
+  assert(proto > 0);
+  static auto cb = [](lws_int ec, const lws_int* peers, lws_size count, lws_context ud) {
+    accepts_handler* f = (accepts_handler*)ud;
+    (*f)(ec, peers, count);
+    if (ec && count == 0) {
+      delete f;
+    }
+  };
+  auto ud = new accepts_handler(handler);
+  return ::lws_acceptbatch(id, proto, max_batch, cb, ud);
+}
+
 inline lws_int connect(lws_int id, const char* host, lws_ushort port){
   assert(id > 0);
   assert(host && port);
@@ -387,6 +513,77 @@ inline lws_int send(lws_int id, const char* data, lws_size size, Handler&& handl
   return ::lws_send(id, data, size, cb, ud);
 }
 
+/* void(int ec, lws_size size), data must stay valid until the handler is called */
+template <typename Handler>
+inline lws_int sendref(lws_int id, const char* data, lws_size size, Handler&& handler) {
+  assert(id > 0);
+  assert(data);
+  static auto cb = [](lws_int ec, lws_size bytes, lws_context ud) {
+    send_handler* f = (send_handler*)ud;
+    (*f)(ec, bytes);
+    delete f;
+  };
+  auto ud = new send_handler(handler);
+  lws_int ok = ::lws_sendref(id, data, size, cb, ud);
+  if (ok != lws_true) {
+    delete ud;
+  }
+  return ok;
+}
+
+/* ids of closed sockets are taken out, count is updated */
+inline lws_int broadcast(lws_int* ids, lws_size* count, const char* data, lws_size size) {
+  assert(ids && count);
+  assert(data);
+  return ::lws_broadcast(ids, count, data, size);
+}
+
+inline lws_int pending(lws_int id, lws_size* bytes) {
+  assert(id > 0);
+  return ::lws_pending(id, bytes);
+}
+
+inline lws_int watermark(lws_int id, lws_size high, lws_size low) {
+  assert(id > 0);
+  return ::lws_watermark(id, high, low);
+}
+
+inline lws_int ondrain(lws_int id, lws_on_drain f, lws_context ud) {
+  assert(id > 0);
+  return ::lws_ondrain(id, f, ud);
+}
+
+inline lws_int setframing(lws_int id, lws_framing type, lws_size max_size) {
+  assert(id > 0);
+  return ::lws_setframing(id, type, max_size);
+}
+
+inline lws_int setdeflate(lws_int id, const lws_deflate* opt) {
+  assert(id > 0);
+  return ::lws_setdeflate(id, opt);
+}
+
+inline lws_int setkcp(lws_int id, const lws_kcp* opt) {
+  assert(id > 0);
+  return ::lws_setkcp(id, opt);
+}
+
+inline lws_int detach(lws_int id) {
+  assert(id > 0);
+  return ::lws_detach(id);
+}
+
+inline lws_int adopt(lws_int token) {
+  lws_int st = getlocal();
+  assert(st > 0);
+  return ::lws_adopt(st, token);
+}
+
+inline lws_int adopt(lws_int st, lws_int token) {
+  assert(st > 0);
+  return ::lws_adopt(st, token);
+}
+
 inline lws_int read(lws_int id, lws_on_receive f, lws_context ud) {
   assert(id > 0);
   return ::lws_read(id, f, ud);
@@ -420,6 +617,26 @@ inline lws_int receive(lws_int id, Handler&& handler) {
   return ::lws_receive(id, cb, ud);
 }
 
+inline lws_int recvbatch(lws_int id, lws_size max_count, lws_on_batch f, lws_context ud) {
+  assert(id > 0);
+  return ::lws_recvbatch(id, max_count, f, ud);
+}
+
+/* void(int ec, const lws_slice* items, lws_size count) */
+template <typename Handler>
+inline lws_int recvbatch(lws_int id, lws_size max_count, Handler&& handler) {
+  assert(id > 0);
+  static auto cb = [](lws_int ec, const lws_slice* items, lws_size count, lws_context ud) {
+    batch_handler* f = (batch_handler*)ud;
+    (*f)(ec, items, count);
+    if (ec) {
+      delete f;
+    }
+  };
+  auto ud = new batch_handler(handler);
+  return ::lws_recvbatch(id, max_count, cb, ud);
+}
+
 /********************************************************************************/
 } //namespace lnf
 /********************************************************************************/